@@ -0,0 +1,307 @@
+/*
+ * Copyright © 2013 The xf86-video-rpifb authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <pixman.h>
+
+#include "bench_chain.h"
+#include "rpi_adapt.h"
+#include "rpi_stats.h"
+#include "small_blt.h"
+
+/* The entries of bench_chain_t.copy_route, the same as RPI_ROUTE_* */
+#define BENCH_ROUTE_KNOWN       1
+#define BENCH_ROUTE_ACCEL       2
+#define BENCH_ROUTE_CPU_BACKEND 4
+#define BENCH_ROUTE_SMALL       8
+
+int bench_chain_init(bench_chain_t *chain, const char *accel,
+                     rpi_disp_t *disp, cpu_backend_t *cpu_backend)
+{
+    memset(chain, 0, sizeof(*chain));
+    chain->fb_begin = cpu_backend->uncached_area_begin;
+    chain->fb_end = cpu_backend->uncached_area_end;
+    if (strcmp(accel, "rpi") == 0) {
+        chain->blt2d = &disp->blt2d;
+        chain->blt2d_cpu_backend = &cpu_backend->blt2d;
+        return 1;
+    }
+    if (strcmp(accel, "none") == 0) {
+        chain->blt2d = &cpu_backend->blt2d;
+        chain->blt2d_cpu_backend = NULL;
+        return 1;
+    }
+    return 0;
+}
+
+void bench_generic_blt(uint32_t *src_bits, uint32_t *dst_bits,
+                       int src_stride, int dst_stride, int bpp,
+                       int src_x, int src_y, int dst_x, int dst_y,
+                       int w, int h, int upsidedown)
+{
+    int bytes_pp = bpp / 8;
+    uint8_t *src = (uint8_t *)src_bits + src_y * src_stride * 4 +
+                   src_x * bytes_pp;
+    uint8_t *dst = (uint8_t *)dst_bits + dst_y * dst_stride * 4 +
+                   dst_x * bytes_pp;
+    int y;
+
+    if (upsidedown) {
+        for (y = h - 1; y >= 0; y--)
+            memmove(dst + y * dst_stride * 4, src + y * src_stride * 4,
+                    w * bytes_pp);
+    }
+    else {
+        for (y = 0; y < h; y++)
+            memmove(dst + y * dst_stride * 4, src + y * src_stride * 4,
+                    w * bytes_pp);
+    }
+}
+
+void bench_generic_fill(uint32_t *bits, int stride, int bpp, int x, int y,
+                        int w, int h, uint32_t color)
+{
+    int i, j;
+
+    for (j = y; j < y + h; j++) {
+        uint8_t *line = (uint8_t *)(bits + j * stride);
+        for (i = x; i < x + w; i++) {
+            switch (bpp) {
+            case 8:
+                line[i] = color;
+                break;
+            case 16:
+                ((uint16_t *)line)[i] = color;
+                break;
+            case 24:
+                line[i * 3] = color;
+                line[i * 3 + 1] = color >> 8;
+                line[i * 3 + 2] = color >> 16;
+                break;
+            default:
+                ((uint32_t *)line)[i] = color;
+                break;
+            }
+        }
+    }
+}
+
+static int
+bench_chain_route(blt2d_i *blt2d, uint32_t *src, uint32_t *dst,
+                  int src_stride, int dst_stride, int bpp, int reverse,
+                  int upsidedown, int width_class)
+{
+    int max_w = width_class == RPI_STATS_NUM_SIZE_BUCKETS - 1 ?
+                INT_MAX : 2 << width_class;
+    if (!blt2d->overlapped_blt_route)
+        return BLT2D_ROUTE_MAYBE;
+    return blt2d->overlapped_blt_route(blt2d->self, src, dst, src_stride,
+                                       dst_stride, bpp, bpp, reverse,
+                                       upsidedown, 1 << width_class, max_w);
+}
+
+/* The same as xCopyRouteStages and xCopyBoxStages in rpi_x.c */
+static int
+bench_chain_copy_stages(bench_chain_t *chain, uint32_t *src, uint32_t *dst,
+                        int src_stride, int dst_stride, int bpp, int reverse,
+                        int upsidedown, int w)
+{
+    int width_class = rpi_adapt_width_class(w);
+    uint8_t *entry = &chain->copy_route[rpi_stats_bpp_index(bpp)]
+                         [(reverse ? 2 : 0) + (upsidedown ? 1 : 0)]
+                         [(uint8_t *)src >= chain->fb_begin &&
+                          (uint8_t *)src < chain->fb_end]
+                         [(uint8_t *)dst >= chain->fb_begin &&
+                          (uint8_t *)dst < chain->fb_end]
+                         [src == dst]
+                         [width_class];
+    int route;
+
+    if (*entry)
+        return *entry;
+    *entry = BENCH_ROUTE_KNOWN;
+    if (small_blt_width_class_ok(bpp, width_class)) {
+        *entry |= BENCH_ROUTE_SMALL;
+        return *entry;
+    }
+    route = bench_chain_route(chain->blt2d, src, dst, src_stride, dst_stride,
+                              bpp, reverse, upsidedown, width_class);
+    if (route != BLT2D_ROUTE_NEVER)
+        *entry |= BENCH_ROUTE_ACCEL;
+    if (route != BLT2D_ROUTE_ALWAYS && chain->blt2d_cpu_backend &&
+        bench_chain_route(chain->blt2d_cpu_backend, src, dst, src_stride,
+                          dst_stride, bpp, reverse, upsidedown,
+                          width_class) != BLT2D_ROUTE_NEVER)
+        *entry |= BENCH_ROUTE_CPU_BACKEND;
+    return *entry;
+}
+
+int bench_chain_copy(bench_chain_t *chain, int op, uint32_t *src,
+                     uint32_t *dst, int src_stride, int dst_stride, int bpp,
+                     int src_x, int src_y, int dst_x, int dst_y, int w, int h,
+                     int reverse, int upsidedown)
+{
+    int done = 0;
+    int stage = RPI_STATS_STAGE_FB;
+    int stages = bench_chain_copy_stages(chain, src, dst, src_stride,
+                                         dst_stride, bpp, reverse,
+                                         upsidedown, w);
+
+    if (stages & BENCH_ROUTE_SMALL) {
+        stage = RPI_STATS_STAGE_SMALL;
+        done = small_blt(src, dst, src_stride, dst_stride, bpp,
+                         src_x, src_y, dst_x, dst_y, w, h, upsidedown);
+    }
+    if (!done && (stages & BENCH_ROUTE_ACCEL)) {
+        stage = RPI_STATS_STAGE_ACCEL;
+        done = chain->blt2d->overlapped_blt(chain->blt2d->self, src, dst,
+                                            src_stride, dst_stride, bpp, bpp,
+                                            src_x, src_y, dst_x, dst_y, w, h);
+    }
+    if (!done && (stages & BENCH_ROUTE_CPU_BACKEND)) {
+        stage = RPI_STATS_STAGE_CPU_BACKEND;
+        done = chain->blt2d_cpu_backend->overlapped_blt(
+                         chain->blt2d_cpu_backend->self, src, dst,
+                         src_stride, dst_stride, bpp, bpp,
+                         src_x, src_y, dst_x, dst_y, w, h);
+    }
+    /* CopyWindow doesn't try pixman */
+    if (!done && op == RPI_STATS_OP_COPY_AREA) {
+        stage = RPI_STATS_STAGE_PIXMAN;
+        if (!reverse && !upsidedown)
+            done = pixman_blt(src, dst, src_stride, dst_stride, bpp, bpp,
+                              src_x, src_y, dst_x, dst_y, w, h);
+    }
+    if (!done) {
+        stage = RPI_STATS_STAGE_FB;
+        bench_generic_blt(src, dst, src_stride, dst_stride, bpp,
+                          src_x, src_y, dst_x, dst_y, w, h, upsidedown);
+    }
+    return stage;
+}
+
+int bench_chain_put_image(bench_chain_t *chain, uint32_t *src, uint32_t *dst,
+                          int src_stride, int dst_stride, int bpp,
+                          int src_x, int src_y, int dst_x, int dst_y,
+                          int w, int h)
+{
+    if (small_blt(src, dst, src_stride, dst_stride, bpp,
+                  src_x, src_y, dst_x, dst_y, w, h, 0))
+        return RPI_STATS_STAGE_SMALL;
+    if (pixman_blt(src, dst, src_stride, dst_stride, bpp, bpp,
+                   src_x, src_y, dst_x, dst_y, w, h))
+        return RPI_STATS_STAGE_PIXMAN;
+    if (bpp == 8 || bpp == 24) {
+        blt2d_i *cpu_backend = chain->blt2d_cpu_backend ?
+                               chain->blt2d_cpu_backend : chain->blt2d;
+        if (cpu_backend->overlapped_blt(cpu_backend->self, src, dst,
+                                        src_stride, dst_stride, bpp, bpp,
+                                        src_x, src_y, dst_x, dst_y, w, h))
+            return RPI_STATS_STAGE_CPU_BACKEND;
+    }
+    bench_generic_blt(src, dst, src_stride, dst_stride, bpp,
+                      src_x, src_y, dst_x, dst_y, w, h, 0);
+    return RPI_STATS_STAGE_FB;
+}
+
+int bench_chain_fill(bench_chain_t *chain, uint32_t *dst, int stride,
+                     int bpp, int x, int y, int w, int h, uint32_t color)
+{
+    /* A batch of one box, as submitted by xFillBoxes in rpi_x.c */
+    blt2d_box_t box = { x, y, x + w, y + h };
+    blt2d_i *cpu_backend = chain->blt2d_cpu_backend;
+
+    if (chain->blt2d->fill_boxes != NULL &&
+        chain->blt2d->fill_boxes(chain->blt2d->self, dst, stride, bpp,
+                                 &box, 1, 0, 0, color))
+        return RPI_STATS_STAGE_ACCEL;
+    if (cpu_backend != NULL && cpu_backend->fill_boxes != NULL &&
+        cpu_backend->fill_boxes(cpu_backend->self, dst, stride, bpp,
+                                &box, 1, 0, 0, color))
+        return RPI_STATS_STAGE_CPU_BACKEND;
+    if (chain->blt2d->fill != NULL &&
+        chain->blt2d->fill(chain->blt2d->self, dst, stride, bpp,
+                           x, y, w, h, color))
+        return RPI_STATS_STAGE_ACCEL;
+    if (pixman_fill(dst, stride, bpp, x, y, w, h, color))
+        return RPI_STATS_STAGE_PIXMAN;
+    bench_generic_fill(dst, stride, bpp, x, y, w, h, color);
+    return RPI_STATS_STAGE_FB;
+}
+
+int bench_chain_get_image(bench_chain_t *chain, uint32_t *src, uint32_t *dst,
+                          int src_stride, int dst_stride, int bpp,
+                          int src_x, int src_y, int w, int h)
+{
+    blt2d_i *cpu_backend = chain->blt2d_cpu_backend;
+
+    if (chain->blt2d->readback_blt != NULL &&
+        chain->blt2d->readback_blt(chain->blt2d->self, src, dst, src_stride,
+                                   dst_stride, bpp, src_x, src_y, 0, 0, w, h))
+        return RPI_STATS_STAGE_ACCEL;
+    if (cpu_backend != NULL && cpu_backend->readback_blt != NULL &&
+        cpu_backend->readback_blt(cpu_backend->self, src, dst, src_stride,
+                                  dst_stride, bpp, src_x, src_y, 0, 0, w, h))
+        return RPI_STATS_STAGE_CPU_BACKEND;
+    if (pixman_blt(src, dst, src_stride, dst_stride, bpp, bpp,
+                   src_x, src_y, 0, 0, w, h))
+        return RPI_STATS_STAGE_PIXMAN;
+    bench_generic_blt(src, dst, src_stride, dst_stride, bpp,
+                      src_x, src_y, 0, 0, w, h, 0);
+    return RPI_STATS_STAGE_FB;
+}
+
+int bench_chain_fill_spans(bench_chain_t *chain, uint32_t *dst, int stride,
+                           int bpp, const blt2d_span_t *spans, int nspan,
+                           uint32_t color)
+{
+    blt2d_i *cpu_backend = chain->blt2d_cpu_backend;
+    int stage = RPI_STATS_STAGE_FB;
+    int first = 1;
+
+    while (nspan > 0) {
+        int n = 0;
+        int s = RPI_STATS_STAGE_ACCEL;
+        if (chain->blt2d->fill_spans != NULL)
+            n = chain->blt2d->fill_spans(chain->blt2d->self, dst, stride, bpp,
+                                         spans, nspan, 0, 0, color);
+        if (n == 0 && cpu_backend != NULL && cpu_backend->fill_spans != NULL) {
+            s = RPI_STATS_STAGE_CPU_BACKEND;
+            n = cpu_backend->fill_spans(cpu_backend->self, dst, stride, bpp,
+                                        spans, nspan, 0, 0, color);
+        }
+        if (n == 0) {
+            s = bench_chain_fill(chain, dst, stride, bpp, spans->x, spans->y,
+                                 spans->width, 1, color);
+            n = 1;
+        }
+        if (first)
+            stage = s;
+        first = 0;
+        spans += n;
+        nspan -= n;
+    }
+    return stage;
+}
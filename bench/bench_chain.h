@@ -0,0 +1,90 @@
+/*
+ * Copyright © 2013 The xf86-video-rpifb authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef BENCH_CHAIN_H
+#define BENCH_CHAIN_H
+
+#include <inttypes.h>
+
+#include "cpu_backend.h"
+#include "rpi_disp.h"
+#include "rpi_stats.h"
+
+/*
+ * The fallback chains of the hooks in rpi_x.c, for the standalone
+ * benchmarks. The blt2d_i backends are configured the same way as
+ * FBDevScreenInit does for the given AccelMethod, and a simple row copy or
+ * fill stands in for fbBlt and fbSolid at the end of each chain.
+ */
+typedef struct {
+    blt2d_i *blt2d;             /* as passed to RPIAccel_Init */
+    blt2d_i *blt2d_cpu_backend;
+    /* The framebuffer, which takes the role of the screen pixmap */
+    uint8_t *fb_begin, *fb_end;
+    /* The copy dispatch table, like RPIAccel.copy_route */
+    uint8_t  copy_route[RPI_STATS_NUM_BPP][4][2][2][2]
+                       [RPI_STATS_NUM_SIZE_BUCKETS];
+} bench_chain_t;
+
+/* accel is "rpi" or "none", returns 0 for anything else */
+int bench_chain_init(bench_chain_t *chain, const char *accel,
+                     rpi_disp_t *disp, cpu_backend_t *cpu_backend);
+
+/*
+ * The chains of xCopyNtoN (op RPI_STATS_OP_COPY_AREA), xCopyWindowProc
+ * (RPI_STATS_OP_COPY_WINDOW), xPutImage and xPolyFillRect. The strides are
+ * in 32-bit words. They return the RPI_STATS_STAGE_* which did the work.
+ */
+int bench_chain_copy(bench_chain_t *chain, int op, uint32_t *src,
+                     uint32_t *dst, int src_stride, int dst_stride, int bpp,
+                     int src_x, int src_y, int dst_x, int dst_y, int w, int h,
+                     int reverse, int upsidedown);
+int bench_chain_put_image(bench_chain_t *chain, uint32_t *src, uint32_t *dst,
+                          int src_stride, int dst_stride, int bpp,
+                          int src_x, int src_y, int dst_x, int dst_y,
+                          int w, int h);
+int bench_chain_fill(bench_chain_t *chain, uint32_t *dst, int stride,
+                     int bpp, int x, int y, int w, int h, uint32_t color);
+
+/* The chain of xGetImage, the image is written at the start of dst */
+int bench_chain_get_image(bench_chain_t *chain, uint32_t *src, uint32_t *dst,
+                          int src_stride, int dst_stride, int bpp,
+                          int src_x, int src_y, int w, int h);
+
+/*
+ * The chain of xFillSpanList for a list of spans, returns the stage which
+ * did the first span.
+ */
+int bench_chain_fill_spans(bench_chain_t *chain, uint32_t *dst, int stride,
+                           int bpp, const blt2d_span_t *spans, int nspan,
+                           uint32_t color);
+
+/* The stand-ins for fbBlt and fbSolid */
+void bench_generic_blt(uint32_t *src_bits, uint32_t *dst_bits,
+                       int src_stride, int dst_stride, int bpp,
+                       int src_x, int src_y, int dst_x, int dst_y,
+                       int w, int h, int upsidedown);
+void bench_generic_fill(uint32_t *bits, int stride, int bpp, int x, int y,
+                        int w, int h, uint32_t color);
+
+#endif
@@ -0,0 +1,132 @@
+#!/bin/sh
+#
+# Copyright © 2013 The xf86-video-rpifb authors
+#
+# Permission is hereby granted, free of charge, to any person obtaining a
+# copy of this software and associated documentation files (the "Software"),
+# to deal in the Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice (including the next
+# paragraph) shall be included in all copies or substantial portions of the
+# Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+# THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+# DEALINGS IN THE SOFTWARE.
+#
+# Compare two builds or two configurations of the driver with rpifb-benchx,
+# at several resolutions and depths. Prints the same "Speed up / Slow down"
+# table as the performance-comparison file, optionally writes the rows as
+# JSON, and fails when any row of B is slower than A by more than the
+# tolerance, or when a row of A is missing from B. For example:
+#
+#   bench/rpifb-compare.sh "bench/rpifb-benchx -a none" "bench/rpifb-benchx -a rpi"
+#   bench/rpifb-compare.sh "bench/rpifb-benchx -s" "bench/rpifb-benchx"
+#   bench/rpifb-compare.sh ../old/bench/rpifb-benchx bench/rpifb-benchx
+
+tolerance=10
+resolutions="1280x1024"
+depths="16 32"
+json=""
+time=0.1
+
+usage() {
+    echo "Usage: $0 [-t percent] [-r \"WxH ...\"] [-b \"bpp ...\"] [-m seconds] [-o file] \"command A\" \"command B\"" >&2
+    echo "  -t percent   the tolerated slow down of B against A (default $tolerance)" >&2
+    echo "  -r WxH ...   the resolutions (default $resolutions)" >&2
+    echo "  -b bpp ...   the depths (default $depths)" >&2
+    echo "  -m seconds   minimum time per measurement (default $time)" >&2
+    echo "  -o file      also write the comparison as JSON" >&2
+    exit 2
+}
+
+while getopts "t:r:b:m:o:h" opt; do
+    case $opt in
+    t) tolerance=$OPTARG ;;
+    r) resolutions=$OPTARG ;;
+    b) depths=$OPTARG ;;
+    m) time=$OPTARG ;;
+    o) json=$OPTARG ;;
+    *) usage ;;
+    esac
+done
+shift $((OPTIND - 1))
+[ $# -eq 2 ] || usage
+
+tmp=$(mktemp -d) || exit 2
+trap 'rm -rf "$tmp"' EXIT
+
+for res in $resolutions; do
+    for bpp in $depths; do
+        $1 -r "$res" -b "$bpp" -t "$time" >> "$tmp/a" || exit 2
+        $2 -r "$res" -b "$bpp" -t "$time" >> "$tmp/b" || exit 2
+    done
+done
+
+awk -v tolerance="$tolerance" -v json="$json" -v a_name="$1" -v b_name="$2" '
+function field(line, name,    s) {
+    s = line
+    if (!match(s, "\"" name "\": *\"?[^\",}]*"))
+        return ""
+    s = substr(s, RSTART, RLENGTH)
+    sub("\"" name "\": *\"?", "", s)
+    return s
+}
+/"test":/ {
+    key = field($0, "resolution") " " field($0, "bpp") " " field($0, "test") " " field($0, "size")
+    if (FILENAME ~ /\/a$/) {
+        a[key] = field($0, "ops_per_sec")
+        order[n++] = key
+    }
+    else
+        b[key] = field($0, "ops_per_sec")
+}
+END {
+    regressions = 0
+    missing = 0
+    if (json != "")
+        printf "{\n  \"a\": \"%s\",\n  \"b\": \"%s\",\n  \"tolerance\": %s,\n  \"rows\": [", a_name, b_name, tolerance > json
+    for (i = 0; i < n; i++) {
+        key = order[i]
+        split(key, k, " ")
+        if (k[1] " " k[2] != section) {
+            section = k[1] " " k[2]
+            printf "%sResolution %s, %sbpp:\n", i ? "\n" : "", k[1], k[2]
+        }
+        if (!(key in b)) {
+            printf "%s (%s x %s): MISSING from B\n", k[3], k[4], k[4]
+            missing++
+            continue
+        }
+        if (a[key] <= 0)
+            continue
+        change = (b[key] / a[key] - 1) * 100
+        if (change >= 0)
+            printf "%s (%s x %s): Speed up %d%%", k[3], k[4], k[4], change + 0.5
+        else
+            printf "%s (%s x %s): Slow down %d%%", k[3], k[4], k[4], -change + 0.5
+        if (change < -tolerance) {
+            printf " REGRESSION"
+            regressions++
+        }
+        printf "\n"
+        if (json != "")
+            printf "%s\n    {\"resolution\": \"%s\", \"bpp\": %s, \"test\": \"%s\", \"size\": %s, \"a_ops_per_sec\": %s, \"b_ops_per_sec\": %s, \"change_percent\": %.1f, \"regression\": %s}", rows++ ? "," : "", k[1], k[2], k[3], k[4], a[key], b[key], change, change < -tolerance ? "true" : "false" > json
+    }
+    if (json != "")
+        printf "\n  ]\n}\n" > json
+    if (regressions)
+        printf "\n%d rows slowed down by more than %s%%\n", regressions, tolerance
+    if (missing)
+        printf "\n%d rows of A are missing from B\n", missing
+    if (regressions || missing)
+        exit 1
+}
+' "$tmp/a" "$tmp/b"
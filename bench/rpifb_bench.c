@@ -0,0 +1,467 @@
+/*
+ * Copyright © 2013 The xf86-video-rpifb authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Standalone microbenchmark for the blt2d_i implementations.
+ *
+ * The benchmark runs without an X server: a plain memory buffer takes the
+ * role of the framebuffer (it is registered as the uncached area of the CPU
+ * backend and as the framebuffer of the rpi_disp backend), and every
+ * overlapped_blt, standard_blt and fill implementation is driven directly
+ * over the same size ladder that benchx uses. The "chain" implementation
+ * reproduces the fallback cascade of rpi_x.c, with a simple row copy or fill
+ * standing in for fbBlt/fbSolid.
+ *
+ * Results are written as JSON.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <inttypes.h>
+#include <pixman.h>
+
+#include "cpu_backend.h"
+#include "rpi_disp.h"
+
+#define BENCH_FB_WIDTH  1280
+#define BENCH_FB_HEIGHT 1024
+/* Position of the test rectangles in the framebuffer */
+#define BENCH_ORIGIN    16
+/* Distance between source and destination for overlapped copies */
+#define BENCH_SHIFT     4
+
+/* The same size ladder as used by benchx (see performance-comparison) */
+static const int bench_sizes[] = {
+    5, 7, 10, 15, 22, 33, 49, 73, 109, 163, 244, 366, 549
+};
+
+#define BENCH_NUM_SIZES (sizeof(bench_sizes) / sizeof(bench_sizes[0]))
+
+enum {
+    BENCH_DIR_UP,
+    BENCH_DIR_DOWN,
+    BENCH_DIR_LEFT,
+    BENCH_DIR_RIGHT,
+    BENCH_NUM_DIRS
+};
+
+static const char *bench_dir_names[BENCH_NUM_DIRS] = {
+    "up", "down", "left", "right"
+};
+
+enum {
+    BENCH_IMPL_DISP,
+    BENCH_IMPL_CPU,
+    BENCH_IMPL_PIXMAN,
+    BENCH_IMPL_CHAIN,
+    BENCH_NUM_IMPLS
+};
+
+static const char *bench_impl_names[BENCH_NUM_IMPLS] = {
+    "disp", "cpu", "pixman", "chain"
+};
+
+typedef struct {
+    uint32_t       *fb_bits;      /* memory standing in for the framebuffer */
+    uint32_t       *pixmap_bits;  /* ordinary cached memory (a "pixmap") */
+    int             bpp;
+    int             stride;       /* in 32-bit words, same for both buffers */
+    rpi_disp_t     *disp;
+    cpu_backend_t  *cpu_backend;
+    double          min_time;
+    FILE           *out;
+    int             nresults;
+} bench_t;
+
+/* The arguments of a single blit or fill request */
+typedef struct {
+    uint32_t *src_bits;
+    uint32_t *dst_bits;
+    int       src_x, src_y;
+    int       dst_x, dst_y;
+    int       w, h;
+    int       reverse, upsidedown;
+} bench_op_t;
+
+typedef int (*bench_fn_t)(bench_t *bench, bench_op_t *op, int impl);
+
+static double
+bench_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * Generic row by row copy and fill, standing in for fbBlt and fbSolid
+ * at the end of the fallback chain.
+ */
+static void
+bench_generic_blt(bench_t *bench, bench_op_t *op)
+{
+    int bytes_pp = bench->bpp / 8;
+    int stride = bench->stride * 4;
+    uint8_t *src = (uint8_t *)op->src_bits + op->src_y * stride +
+                   op->src_x * bytes_pp;
+    uint8_t *dst = (uint8_t *)op->dst_bits + op->dst_y * stride +
+                   op->dst_x * bytes_pp;
+    int y;
+
+    if (op->upsidedown) {
+        for (y = op->h - 1; y >= 0; y--)
+            memmove(dst + y * stride, src + y * stride, op->w * bytes_pp);
+    }
+    else {
+        for (y = 0; y < op->h; y++)
+            memmove(dst + y * stride, src + y * stride, op->w * bytes_pp);
+    }
+}
+
+static void
+bench_generic_fill(bench_t *bench, bench_op_t *op, uint32_t color)
+{
+    int x, y;
+
+    for (y = op->dst_y; y < op->dst_y + op->h; y++) {
+        uint32_t *line = op->dst_bits + y * bench->stride;
+        if (bench->bpp == 16) {
+            for (x = op->dst_x; x < op->dst_x + op->w; x++)
+                ((uint16_t *)line)[x] = color;
+        }
+        else {
+            for (x = op->dst_x; x < op->dst_x + op->w; x++)
+                line[x] = color;
+        }
+    }
+}
+
+#define BENCH_BLT_ARGS(op) \
+    (op)->src_bits, (op)->dst_bits, bench->stride, bench->stride, \
+    bench->bpp, bench->bpp, (op)->src_x, (op)->src_y, \
+    (op)->dst_x, (op)->dst_y, (op)->w, (op)->h
+
+/*
+ * Returns 1 if the operation was done, 0 if the implementation declined it
+ * and -1 if the implementation is not available at all.
+ */
+static int
+bench_overlapped_blt(bench_t *bench, bench_op_t *op, int impl)
+{
+    blt2d_i *disp = &bench->disp->blt2d;
+    blt2d_i *cpu = &bench->cpu_backend->blt2d;
+    int done;
+
+    switch (impl) {
+    case BENCH_IMPL_DISP:
+        return disp->overlapped_blt(disp->self, BENCH_BLT_ARGS(op));
+    case BENCH_IMPL_CPU:
+        return cpu->overlapped_blt(cpu->self, BENCH_BLT_ARGS(op));
+    case BENCH_IMPL_PIXMAN:
+        if (op->reverse || op->upsidedown)
+            return -1;
+        return pixman_blt(BENCH_BLT_ARGS(op));
+    case BENCH_IMPL_CHAIN:
+        /* The same order as xCopyNtoN with AccelMethod "rpi" */
+        done = disp->overlapped_blt(disp->self, BENCH_BLT_ARGS(op));
+        if (!done)
+            done = cpu->overlapped_blt(cpu->self, BENCH_BLT_ARGS(op));
+        if (!done && !op->reverse && !op->upsidedown)
+            done = pixman_blt(BENCH_BLT_ARGS(op));
+        if (!done)
+            bench_generic_blt(bench, op);
+        return 1;
+    }
+    return -1;
+}
+
+static int
+bench_standard_blt(bench_t *bench, bench_op_t *op, int impl)
+{
+    blt2d_i *cpu = &bench->cpu_backend->blt2d;
+    int done;
+
+    switch (impl) {
+    case BENCH_IMPL_DISP:
+        /* rpi_disp doesn't provide a standard_blt implementation */
+        if (bench->disp->blt2d.standard_blt == NULL)
+            return -1;
+        return bench->disp->blt2d.standard_blt(bench->disp->blt2d.self,
+                                               BENCH_BLT_ARGS(op));
+    case BENCH_IMPL_CPU:
+        if (cpu->standard_blt == NULL)
+            return -1;
+        return cpu->standard_blt(cpu->self, BENCH_BLT_ARGS(op));
+    case BENCH_IMPL_PIXMAN:
+        return pixman_blt(BENCH_BLT_ARGS(op));
+    case BENCH_IMPL_CHAIN:
+        /* The same order as xPutImage */
+        done = pixman_blt(BENCH_BLT_ARGS(op));
+        if (!done)
+            bench_generic_blt(bench, op);
+        return 1;
+    }
+    return -1;
+}
+
+#define BENCH_FILL_COLOR 0x5A5A5A5A
+
+#define BENCH_FILL_ARGS(op) \
+    (op)->dst_bits, bench->stride, bench->bpp, (op)->dst_x, (op)->dst_y, \
+    (op)->w, (op)->h, BENCH_FILL_COLOR
+
+static int
+bench_fill(bench_t *bench, bench_op_t *op, int impl)
+{
+    blt2d_i *disp = &bench->disp->blt2d;
+    blt2d_i *cpu = &bench->cpu_backend->blt2d;
+    int done;
+
+    switch (impl) {
+    case BENCH_IMPL_DISP:
+        return disp->fill(disp->self, BENCH_FILL_ARGS(op));
+    case BENCH_IMPL_CPU:
+        if (cpu->fill == NULL)
+            return -1;
+        return cpu->fill(cpu->self, BENCH_FILL_ARGS(op));
+    case BENCH_IMPL_PIXMAN:
+        return pixman_fill(BENCH_FILL_ARGS(op));
+    case BENCH_IMPL_CHAIN:
+        /* The same order as xPolyFillRect */
+        done = disp->fill(disp->self, BENCH_FILL_ARGS(op));
+        if (!done)
+            done = pixman_fill(BENCH_FILL_ARGS(op));
+        if (!done)
+            bench_generic_fill(bench, op, BENCH_FILL_COLOR);
+        return 1;
+    }
+    return -1;
+}
+
+static void
+bench_report(bench_t *bench, const char *opname, int impl, const char *dir,
+             bench_op_t *op, const char *status, long calls, double seconds)
+{
+    fprintf(bench->out, "%s\n    {\"op\": \"%s\", \"impl\": \"%s\", "
+            "\"bpp\": %d, \"dir\": \"%s\", \"width\": %d, \"height\": %d, "
+            "\"status\": \"%s\"",
+            bench->nresults ? "," : "", opname, bench_impl_names[impl],
+            bench->bpp, dir, op->w, op->h, status);
+    if (calls > 0) {
+        fprintf(bench->out, ", \"calls\": %ld, \"seconds\": %.6f, "
+                "\"calls_per_sec\": %.1f, \"mpixels_per_sec\": %.3f",
+                calls, seconds, calls / seconds,
+                (double)calls * op->w * op->h / seconds / 1000000.0);
+    }
+    fprintf(bench->out, "}");
+    bench->nresults++;
+}
+
+static void
+bench_run(bench_t *bench, const char *opname, bench_fn_t fn, int impl,
+          const char *dir, bench_op_t *op)
+{
+    long calls = 0;
+    double start, elapsed;
+    int i, result;
+
+    /* A first call to check whether the implementation handles this case */
+    result = fn(bench, op, impl);
+    if (result <= 0) {
+        bench_report(bench, opname, impl, dir, op,
+                     result < 0 ? "unavailable" : "declined", 0, 0);
+        return;
+    }
+
+    start = bench_time();
+    do {
+        for (i = 0; i < 16; i++)
+            fn(bench, op, impl);
+        calls += 16;
+        elapsed = bench_time() - start;
+    } while (elapsed < bench->min_time);
+
+    bench_report(bench, opname, impl, dir, op, "ok", calls, elapsed);
+}
+
+static void
+bench_setup_overlapped(bench_t *bench, bench_op_t *op, int dir, int size)
+{
+    memset(op, 0, sizeof(*op));
+    op->src_bits = op->dst_bits = bench->fb_bits;
+    op->src_x = op->src_y = op->dst_x = op->dst_y = BENCH_ORIGIN;
+    op->w = op->h = size;
+    switch (dir) {
+    case BENCH_DIR_UP:
+        op->src_y += BENCH_SHIFT;
+        break;
+    case BENCH_DIR_DOWN:
+        op->dst_y += BENCH_SHIFT;
+        op->upsidedown = 1;
+        break;
+    case BENCH_DIR_LEFT:
+        op->src_x += BENCH_SHIFT;
+        break;
+    case BENCH_DIR_RIGHT:
+        op->dst_x += BENCH_SHIFT;
+        op->reverse = 1;
+        break;
+    }
+}
+
+static void
+bench_all(bench_t *bench)
+{
+    bench_op_t op;
+    int i, dir, impl;
+
+    for (i = 0; i < BENCH_NUM_SIZES; i++) {
+        for (dir = 0; dir < BENCH_NUM_DIRS; dir++) {
+            bench_setup_overlapped(bench, &op, dir, bench_sizes[i]);
+            for (impl = 0; impl < BENCH_NUM_IMPLS; impl++)
+                bench_run(bench, "overlapped_blt", bench_overlapped_blt,
+                          impl, bench_dir_names[dir], &op);
+        }
+    }
+
+    for (i = 0; i < BENCH_NUM_SIZES; i++) {
+        memset(&op, 0, sizeof(op));
+        op.src_bits = bench->pixmap_bits;
+        op.dst_bits = bench->fb_bits;
+        op.src_x = op.src_y = op.dst_x = op.dst_y = BENCH_ORIGIN;
+        op.w = op.h = bench_sizes[i];
+        for (impl = 0; impl < BENCH_NUM_IMPLS; impl++)
+            bench_run(bench, "standard_blt", bench_standard_blt, impl,
+                      "none", &op);
+    }
+
+    for (i = 0; i < BENCH_NUM_SIZES; i++) {
+        memset(&op, 0, sizeof(op));
+        op.dst_bits = bench->fb_bits;
+        op.dst_x = op.dst_y = BENCH_ORIGIN;
+        op.w = op.h = bench_sizes[i];
+        for (impl = 0; impl < BENCH_NUM_IMPLS; impl++)
+            bench_run(bench, "fill", bench_fill, impl, "none", &op);
+    }
+}
+
+static void
+usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [-b bpp] [-t seconds] [-o file]\n"
+            "  -b bpp      only run at the given depth (16 or 32)\n"
+            "  -t seconds  minimum time spent per measurement (default 0.1)\n"
+            "  -o file     write the JSON results to file instead of stdout\n",
+            name);
+}
+
+int
+main(int argc, char *argv[])
+{
+    static const int all_bpp[] = { 16, 32 };
+    bench_t bench;
+    size_t size = BENCH_FB_WIDTH * BENCH_FB_HEIGHT * 4;
+    void *fb_mem, *pixmap_mem;
+    int only_bpp = 0;
+    int c, i;
+
+    memset(&bench, 0, sizeof(bench));
+    bench.min_time = 0.1;
+    bench.out = stdout;
+
+    while ((c = getopt(argc, argv, "b:t:o:h")) != -1) {
+        switch (c) {
+        case 'b':
+            only_bpp = atoi(optarg);
+            if (only_bpp != 16 && only_bpp != 32) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 't':
+            bench.min_time = atof(optarg);
+            break;
+        case 'o':
+            bench.out = fopen(optarg, "w");
+            if (!bench.out) {
+                perror(optarg);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (posix_memalign(&fb_mem, 4096, size) != 0 ||
+        posix_memalign(&pixmap_mem, 4096, size) != 0) {
+        fprintf(stderr, "failed to allocate the test buffers\n");
+        return 1;
+    }
+    memset(fb_mem, 0x11, size);
+    memset(pixmap_mem, 0x22, size);
+    bench.fb_bits = fb_mem;
+    bench.pixmap_bits = pixmap_mem;
+
+    bench.cpu_backend = cpu_backend_init(fb_mem, size);
+    if (!bench.cpu_backend) {
+        fprintf(stderr, "failed to initialize the CPU backend\n");
+        return 1;
+    }
+
+    fprintf(bench.out, "{\n  \"processor\": \"%s\",\n"
+            "  \"framebuffer\": {\"width\": %d, \"height\": %d},\n"
+            "  \"min_time\": %.3f,\n  \"results\": [",
+            bench.cpu_backend->cpuinfo ?
+                bench.cpu_backend->cpuinfo->processor_name : "Unknown",
+            BENCH_FB_WIDTH, BENCH_FB_HEIGHT, bench.min_time);
+
+    for (i = 0; i < 2; i++) {
+        if (only_bpp && only_bpp != all_bpp[i])
+            continue;
+        bench.bpp = all_bpp[i];
+        bench.stride = BENCH_FB_WIDTH * bench.bpp / 32;
+        bench.disp = rpi_disp_init_memory(fb_mem, BENCH_FB_WIDTH,
+                                          BENCH_FB_HEIGHT, bench.bpp, size);
+        if (!bench.disp) {
+            fprintf(stderr, "failed to initialize the display backend\n");
+            return 1;
+        }
+        bench_all(&bench);
+        rpi_disp_close(bench.disp);
+    }
+
+    fprintf(bench.out, "\n  ]\n}\n");
+    if (bench.out != stdout)
+        fclose(bench.out);
+
+    cpu_backend_close(bench.cpu_backend);
+    free(pixmap_mem);
+    free(fb_mem);
+    return 0;
+}
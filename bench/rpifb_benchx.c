@@ -0,0 +1,437 @@
+/*
+ * Copyright © 2013 The xf86-video-rpifb authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * A benchx-style catalogue of X operations, run through the fallback chains
+ * of rpi_x.c against a memory-backed framebuffer, without an X server.
+ *
+ * Each test of the catalogue performs the work which the driver does for
+ * the corresponding benchx test: the hooked operations go through the
+ * chains of bench_chain.h, Line and FillCircle use the zero_line.h and
+ * fill_arc.h scan conversion, and XRenderShmImage, which the driver doesn't
+ * hook, uses pixman directly.
+ * With -s, drawing goes to a shadow buffer in ordinary memory and every
+ * operation is followed by the copy of the damaged area to the framebuffer,
+ * like the shadow layer does with Option "ShadowFB".
+ *
+ * The results are written as JSON, one result per line, which is what the
+ * rpifb-compare script expects.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <inttypes.h>
+#include <pixman.h>
+
+#include "cpu_backend.h"
+#include "rpi_disp.h"
+#include "rpi_stats.h"
+#include "zero_line.h"
+#include "fill_arc.h"
+#include "bench_chain.h"
+
+/* Distance between source and destination of the screen copies */
+#define BENCHX_SHIFT 4
+
+#define BENCHX_COLOR 0x5A5A5A5A
+
+/* The same size ladder as used by benchx */
+static const int benchx_sizes[] = {
+    5, 7, 10, 15, 22, 33, 49, 73, 109, 163, 244, 366, 549
+};
+
+#define BENCHX_NUM_SIZES (sizeof(benchx_sizes) / sizeof(benchx_sizes[0]))
+
+typedef struct {
+    int            width, height;
+    int            bpp;
+    int            stride;       /* in 32-bit words */
+    uint32_t      *fb_bits;      /* memory standing in for the framebuffer */
+    uint32_t      *screen_bits;  /* the framebuffer, or the shadow */
+    uint32_t      *shadow_bits;  /* NULL without -s */
+    uint32_t      *pixmap_bits;  /* an offscreen pixmap of the screen size */
+    uint32_t      *image_bits;   /* client image data, also screen sized */
+    bench_chain_t  chain;
+    double         min_time;
+    FILE          *out;
+    int            nresults;
+} benchx_t;
+
+typedef void (*benchx_fn_t)(benchx_t *bx, int size, int x, int y);
+
+/*
+ * The shadow layer copies the damaged boxes to the framebuffer after
+ * every operation (shadowUpdatePacked).
+ */
+static void
+benchx_damage(benchx_t *bx, int x, int y, int w, int h)
+{
+    int bytes_pp = bx->bpp / 8;
+    int j;
+
+    if (!bx->shadow_bits)
+        return;
+    for (j = y; j < y + h; j++)
+        memcpy((uint8_t *)(bx->fb_bits + j * bx->stride) + x * bytes_pp,
+               (uint8_t *)(bx->shadow_bits + j * bx->stride) + x * bytes_pp,
+               w * bytes_pp);
+}
+
+static void
+benchx_screen_copy(benchx_t *bx, int size, int x, int y)
+{
+    bench_chain_copy(&bx->chain, RPI_STATS_OP_COPY_AREA, bx->screen_bits,
+                     bx->screen_bits, bx->stride, bx->stride, bx->bpp,
+                     x + BENCHX_SHIFT, y + BENCHX_SHIFT, x, y, size, size,
+                     0, 0);
+    benchx_damage(bx, x, y, size, size);
+}
+
+static void
+benchx_aligned_screen_copy(benchx_t *bx, int size, int x, int y)
+{
+    /* source and destination at 32 byte boundaries */
+    int align = bx->bpp == 24 ? 32 : 256 / bx->bpp;
+    x &= ~(align - 1);
+    bench_chain_copy(&bx->chain, RPI_STATS_OP_COPY_AREA, bx->screen_bits,
+                     bx->screen_bits, bx->stride, bx->stride, bx->bpp,
+                     x + align, y + BENCHX_SHIFT, x, y, size, size, 0, 0);
+    benchx_damage(bx, x, y, size, size);
+}
+
+static void
+benchx_screen_copy_downwards(benchx_t *bx, int size, int x, int y)
+{
+    bench_chain_copy(&bx->chain, RPI_STATS_OP_COPY_AREA, bx->screen_bits,
+                     bx->screen_bits, bx->stride, bx->stride, bx->bpp,
+                     x, y, x, y + BENCHX_SHIFT, size, size, 0, 1);
+    benchx_damage(bx, x, y + BENCHX_SHIFT, size, size);
+}
+
+static void
+benchx_screen_copy_rightwards(benchx_t *bx, int size, int x, int y)
+{
+    bench_chain_copy(&bx->chain, RPI_STATS_OP_COPY_AREA, bx->screen_bits,
+                     bx->screen_bits, bx->stride, bx->stride, bx->bpp,
+                     x, y, x + BENCHX_SHIFT, y, size, size, 1, 0);
+    benchx_damage(bx, x + BENCHX_SHIFT, y, size, size);
+}
+
+static void
+benchx_fill_rect(benchx_t *bx, int size, int x, int y)
+{
+    bench_chain_fill(&bx->chain, bx->screen_bits, bx->stride, bx->bpp,
+                     x, y, size, size, BENCHX_COLOR);
+    benchx_damage(bx, x, y, size, size);
+}
+
+/* XPutImage of a size x size image */
+static void
+benchx_put_image(benchx_t *bx, int size, int x, int y)
+{
+    int image_stride = (size * bx->bpp + 31) / 32;
+    bench_chain_put_image(&bx->chain, bx->image_bits, bx->screen_bits,
+                          image_stride, bx->stride, bx->bpp, 0, 0, x, y,
+                          size, size);
+    benchx_damage(bx, x, y, size, size);
+}
+
+/* XGetImage of a size x size area of the screen */
+static void
+benchx_get_image(benchx_t *bx, int size, int x, int y)
+{
+    int image_stride = (size * bx->bpp + 31) / 32;
+    bench_chain_get_image(&bx->chain, bx->screen_bits, bx->image_bits,
+                          bx->stride, image_stride, bx->bpp, x, y,
+                          size, size);
+}
+
+/*
+ * XShmPutImage of a part of a screen sized shared memory image, which the
+ * server turns into a CopyArea from a pixmap wrapping the segment.
+ */
+static void
+benchx_shm_put_image(benchx_t *bx, int size, int x, int y)
+{
+    bench_chain_copy(&bx->chain, RPI_STATS_OP_COPY_AREA, bx->image_bits,
+                     bx->screen_bits, bx->stride, bx->stride, bx->bpp,
+                     x, y, x, y, size, size, 0, 0);
+    benchx_damage(bx, x, y, size, size);
+}
+
+static void
+benchx_pixmap_copy(benchx_t *bx, int size, int x, int y)
+{
+    bench_chain_copy(&bx->chain, RPI_STATS_OP_COPY_AREA, bx->pixmap_bits,
+                     bx->screen_bits, bx->stride, bx->stride, bx->bpp,
+                     x, y, x, y, size, size, 0, 0);
+    benchx_damage(bx, x, y, size, size);
+}
+
+/*
+ * A zero width diagonal line, which the driver draws with the zero_line.h
+ * kernels, with the error terms set up like in fbSegment.
+ */
+static void
+benchx_line(benchx_t *bx, int size, int x, int y)
+{
+    int adx = size - 1, ady = (size - 1) / 2;
+    int e1 = ady << 1;
+    int e2 = e1 - (adx << 1);
+    int e = e1 - adx;
+
+    zero_line(bx->screen_bits, bx->stride, bx->bpp, x, y, 1, 1, 1,
+              e - e1, e1, e2 - e1, adx + 1, BENCHX_COLOR);
+    benchx_damage(bx, x, y, size, ady + 1);
+}
+
+/*
+ * A filled circle, which the driver scan converts with fill_arc.h into a
+ * list of spans.
+ */
+static void
+benchx_fill_circle(benchx_t *bx, int size, int x, int y)
+{
+    blt2d_span_t spans[64];
+    fill_arc_t arc;
+    int n = 0;
+    int sx, w, y_upper, y_lower, rows;
+
+    fill_arc_init(&arc, x, y, size, size);
+    while ((rows = fill_arc_step(&arc, &sx, &w, &y_upper, &y_lower))) {
+        if (w <= 0)
+            continue;
+        if (n + 2 > 64) {
+            bench_chain_fill_spans(&bx->chain, bx->screen_bits, bx->stride,
+                                   bx->bpp, spans, n, BENCHX_COLOR);
+            n = 0;
+        }
+        spans[n].x = sx;
+        spans[n].y = y_upper;
+        spans[n++].width = w;
+        if (rows == 2) {
+            spans[n].x = sx;
+            spans[n].y = y_lower;
+            spans[n++].width = w;
+        }
+    }
+    bench_chain_fill_spans(&bx->chain, bx->screen_bits, bx->stride, bx->bpp,
+                           spans, n, BENCHX_COLOR);
+    benchx_damage(bx, x, y, size, size);
+}
+
+/* A Render composite (PictOpSrc) of a shared memory image of the same format */
+static void
+benchx_xrender_shm_image(benchx_t *bx, int size, int x, int y)
+{
+    pixman_blt(bx->image_bits, bx->screen_bits, bx->stride, bx->stride,
+               bx->bpp, bx->bpp, x, y, x, y, size, size);
+    benchx_damage(bx, x, y, size, size);
+}
+
+static const struct {
+    const char  *name;
+    benchx_fn_t  fn;
+} benchx_tests[] = {
+    { "ScreenCopy",            benchx_screen_copy },
+    { "AlignedScreenCopy",     benchx_aligned_screen_copy },
+    { "ScreenCopyDownwards",   benchx_screen_copy_downwards },
+    { "ScreenCopyRightwards",  benchx_screen_copy_rightwards },
+    { "FillRect",              benchx_fill_rect },
+    { "PutImage",              benchx_put_image },
+    { "GetImage",              benchx_get_image },
+    { "ShmPutImage",           benchx_shm_put_image },
+    { "PixmapCopy",            benchx_pixmap_copy },
+    { "Line",                  benchx_line },
+    { "FillCircle",            benchx_fill_circle },
+    { "XRenderShmImage",       benchx_xrender_shm_image },
+};
+
+#define BENCHX_NUM_TESTS (sizeof(benchx_tests) / sizeof(benchx_tests[0]))
+
+static double
+benchx_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Walk over the screen, so that the tests don't run in the same spot */
+static void
+benchx_position(benchx_t *bx, int size, long i, int *x, int *y)
+{
+    int range_x = bx->width - size - 32;
+    int range_y = bx->height - size - BENCHX_SHIFT;
+    *x = range_x > 0 ? (i * 97) % range_x : 0;
+    *y = range_y > 0 ? (i * 61) % range_y : 0;
+}
+
+static void
+benchx_run(benchx_t *bx, int test, int size)
+{
+    long ops = 0;
+    double start, elapsed;
+    int i, x, y;
+
+    start = benchx_time();
+    do {
+        for (i = 0; i < 16; i++) {
+            benchx_position(bx, size, ops + i, &x, &y);
+            benchx_tests[test].fn(bx, size, x, y);
+        }
+        ops += 16;
+        elapsed = benchx_time() - start;
+    } while (elapsed < bx->min_time);
+
+    fprintf(bx->out, "%s\n    {\"test\": \"%s\", \"size\": %d, \"bpp\": %d, "
+            "\"resolution\": \"%dx%d\", \"ops_per_sec\": %.1f}",
+            bx->nresults ? "," : "", benchx_tests[test].name, size, bx->bpp,
+            bx->width, bx->height, ops / elapsed);
+    bx->nresults++;
+}
+
+static void
+usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [-a rpi|none] [-s] [-r WxH] [-b bpp] [-t seconds] "
+            "[-o file]\n"
+            "  -a method   run as with the given AccelMethod (default rpi)\n"
+            "  -s          run as with Option \"ShadowFB\"\n"
+            "  -r WxH      the screen resolution (default 1280x1024)\n"
+            "  -b bpp      the depth, 8, 16, 24 or 32 (default 16)\n"
+            "  -t seconds  minimum time spent per measurement (default 0.1)\n"
+            "  -o file     write the JSON results to file instead of stdout\n",
+            name);
+}
+
+int
+main(int argc, char *argv[])
+{
+    benchx_t bx;
+    const char *accel = "rpi";
+    int shadow = 0;
+    size_t size;
+    void *mem[4];
+    rpi_disp_t *disp;
+    cpu_backend_t *cpu_backend;
+    int c, i, test;
+
+    memset(&bx, 0, sizeof(bx));
+    bx.width = 1280;
+    bx.height = 1024;
+    bx.bpp = 16;
+    bx.min_time = 0.1;
+    bx.out = stdout;
+
+    while ((c = getopt(argc, argv, "a:sr:b:t:o:h")) != -1) {
+        switch (c) {
+        case 'a':
+            accel = optarg;
+            break;
+        case 's':
+            shadow = 1;
+            break;
+        case 'r':
+            if (sscanf(optarg, "%dx%d", &bx.width, &bx.height) != 2 ||
+                bx.width < 640 || bx.height < 600) {
+                fprintf(stderr, "the resolution must be at least 640x600\n");
+                return 1;
+            }
+            break;
+        case 'b':
+            bx.bpp = atoi(optarg);
+            if (bx.bpp != 8 && bx.bpp != 16 && bx.bpp != 24 &&
+                bx.bpp != 32) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 't':
+            bx.min_time = atof(optarg);
+            break;
+        case 'o':
+            bx.out = fopen(optarg, "w");
+            if (!bx.out) {
+                perror(optarg);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+
+    /* the rows are padded to whole words, like those of the framebuffer */
+    bx.stride = (bx.width * bx.bpp + 31) / 32;
+    size = (size_t)bx.stride * 4 * bx.height;
+    for (i = 0; i < 4; i++) {
+        if (posix_memalign(&mem[i], 4096, size) != 0) {
+            fprintf(stderr, "failed to allocate the test buffers\n");
+            return 1;
+        }
+        memset(mem[i], 0x11 * (i + 1), size);
+    }
+    bx.fb_bits = mem[0];
+    bx.pixmap_bits = mem[1];
+    bx.image_bits = mem[2];
+    bx.shadow_bits = shadow ? mem[3] : NULL;
+    bx.screen_bits = shadow ? bx.shadow_bits : bx.fb_bits;
+
+    cpu_backend = cpu_backend_init((uint8_t *)bx.fb_bits, size);
+    disp = rpi_disp_init_memory(bx.fb_bits, bx.width, bx.height, bx.bpp,
+                                size);
+    if (!cpu_backend || !disp) {
+        fprintf(stderr, "failed to initialize the backends\n");
+        return 1;
+    }
+    if (!bench_chain_init(&bx.chain, accel, disp, cpu_backend)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    fprintf(bx.out, "{\n  \"processor\": \"%s\",\n  \"accel\": \"%s\",\n"
+            "  \"shadow\": %s,\n  \"min_time\": %.3f,\n  \"results\": [",
+            cpu_backend->cpuinfo ?
+                cpu_backend->cpuinfo->processor_name : "Unknown",
+            accel, shadow ? "true" : "false", bx.min_time);
+
+    for (test = 0; test < BENCHX_NUM_TESTS; test++)
+        for (i = 0; i < BENCHX_NUM_SIZES; i++)
+            benchx_run(&bx, test, benchx_sizes[i]);
+
+    fprintf(bx.out, "\n  ]\n}\n");
+    if (bx.out != stdout)
+        fclose(bx.out);
+
+    rpi_disp_close(disp);
+    cpu_backend_close(cpu_backend);
+    for (i = 0; i < 4; i++)
+        free(mem[i]);
+    return 0;
+}
@@ -0,0 +1,340 @@
+/*
+ * Copyright © 2013 The xf86-video-rpifb authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Bandwidth benchmark of the memcpy variants of arm_asm.S and of
+ * aligned_fetch_fbmem_to_scratch_arm, to decide which variants are worth
+ * keeping in RPI_BEST_MEMCPY_ONLY builds and in the memcpy_tune tables.
+ *
+ * Every variant is timed for a range of sizes (doubling from the minimum
+ * to the maximum size), for all 32 source alignments within a cache line
+ * (and optionally all 32 destination alignments as well), with the source
+ * in ordinary cached memory and in uncached memory. The uncached source is
+ * a mapping of the framebuffer device (or any other mappable device) opened
+ * with O_SYNC. The destination is always cached memory.
+ *
+ * The results are written as CSV with one row per measurement, which can
+ * be pivoted into heat maps of size against alignment:
+ *
+ *   variant,source,size,src_align,dst_align,mbytes_per_sec,cycles_per_byte
+ *
+ * aligned_fetch_fbmem_to_scratch_arm requires 32 byte aligned pointers and
+ * sizes, so it is only timed with both alignments 0 and sizes of at least
+ * 32 bytes. The libc memcpy is included as a reference.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fb.h>
+
+#include "cpu_backend.h"
+#include "memcpy_tune.h"
+#ifdef __arm__
+#include "rpi_arm_asm.h"
+#endif
+
+/* Room for the alignment offsets and the overfetch around each buffer */
+#define MEMCPY_BENCH_MARGIN 64
+
+enum {
+    MEMCPY_BENCH_CACHED,
+    MEMCPY_BENCH_UNCACHED,
+    MEMCPY_BENCH_NUM_SOURCES
+};
+
+static const char *memcpy_bench_source_names[MEMCPY_BENCH_NUM_SOURCES] = {
+    "cached", "uncached"
+};
+
+typedef struct {
+    const char   *name;
+    cpu_memcpy_t  func;
+    int           aligned_fetch;
+} memcpy_bench_variant_t;
+
+static double
+memcpy_bench_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void *
+memcpy_bench_libc(void *dst, const void *src, int size)
+{
+    return memcpy(dst, src, size);
+}
+
+#ifdef __arm__
+static void *
+memcpy_bench_aligned_fetch(void *dst, const void *src, int size)
+{
+    aligned_fetch_fbmem_to_scratch_arm(size, dst, src);
+    return dst;
+}
+#endif
+
+/* The CPU clock in MHz, from cpufreq, or 0 if unknown */
+static double
+memcpy_bench_cpu_mhz(void)
+{
+    FILE *f = fopen("/sys/devices/system/cpu/cpu0/cpufreq/scaling_cur_freq",
+                    "r");
+    double khz = 0;
+    if (!f)
+        return 0;
+    if (fscanf(f, "%lf", &khz) != 1)
+        khz = 0;
+    fclose(f);
+    return khz / 1000;
+}
+
+/* Returns the bandwidth in bytes per second, the best of the given runs */
+static double
+memcpy_bench_measure(cpu_memcpy_t func, uint8_t *dst, const uint8_t *src,
+                     int size, double min_time, int runs)
+{
+    /* Read the clock only every 64 KiB or so, it is slow for small copies */
+    int batch = 1 + 65536 / size;
+    double best = 0;
+    int run, i;
+
+    for (run = 0; run < runs; run++) {
+        double start = memcpy_bench_time(), elapsed;
+        long calls = 0;
+        do {
+            for (i = 0; i < batch; i++)
+                func(dst, src, size);
+            calls += batch;
+            elapsed = memcpy_bench_time() - start;
+        } while (elapsed < min_time);
+        if (calls * (double)size / elapsed > best)
+            best = calls * (double)size / elapsed;
+    }
+    return best;
+}
+
+static void
+usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [-u device] [-s min] [-S max] [-A] [-v name] "
+            "[-c mhz] [-t seconds] [-r runs] [-o file]\n"
+            "  -u device   the device mapped as the uncached source, or \"none\"\n"
+            "              (default /dev/fb0)\n"
+            "  -s min      the smallest size in bytes (default 4)\n"
+            "  -S max      the largest size in bytes (default 8388608)\n"
+            "  -A          sweep all 32x32 source and destination alignments\n"
+            "              instead of only the 32 source alignments\n"
+            "  -v name     only time the variants whose name contains name\n"
+            "  -c mhz      the CPU clock for cycles per byte (default from "
+            "cpufreq)\n"
+            "  -t seconds  the minimum time of each run (default 0.002)\n"
+            "  -r runs     the number of runs, the best is reported "
+            "(default 3)\n"
+            "  -o file     write the CSV to file instead of stdout\n",
+            name);
+}
+
+int
+main(int argc, char *argv[])
+{
+    memcpy_bench_variant_t *variants;
+    const char *device = "/dev/fb0", *filter = NULL;
+    uint8_t *src_area[MEMCPY_BENCH_NUM_SOURCES] = { NULL, NULL };
+    size_t src_area_size[MEMCPY_BENCH_NUM_SOURCES] = { 0, 0 };
+    uint8_t *dst_area, *uncached_map = MAP_FAILED;
+    size_t uncached_map_size = 0;
+    FILE *out = stdout;
+    double min_time = 0.002, mhz = 0;
+    int min_size = 4, max_size = 8 * 1024 * 1024;
+    int all_dst_aligns = 0, runs = 3;
+    int num_variants, i, c;
+    int source, size, src_align, dst_align;
+
+    while ((c = getopt(argc, argv, "u:s:S:Av:c:t:r:o:h")) != -1) {
+        switch (c) {
+        case 'u':
+            device = optarg;
+            break;
+        case 's':
+            min_size = atoi(optarg);
+            break;
+        case 'S':
+            max_size = atoi(optarg);
+            break;
+        case 'A':
+            all_dst_aligns = 1;
+            break;
+        case 'v':
+            filter = optarg;
+            break;
+        case 'c':
+            mhz = atof(optarg);
+            break;
+        case 't':
+            min_time = atof(optarg);
+            break;
+        case 'r':
+            runs = atoi(optarg);
+            break;
+        case 'o':
+            out = fopen(optarg, "w");
+            if (!out) {
+                perror(optarg);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+    if (min_size < 1 || max_size < min_size || runs < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (mhz == 0)
+        mhz = memcpy_bench_cpu_mhz();
+
+    /* The variants of arm_asm.S, the aligned fetch and libc memcpy */
+    num_variants = 0;
+    variants = calloc(memcpy_tune_num_variants() + 2, sizeof(*variants));
+    for (i = 0; i < memcpy_tune_num_variants(); i++) {
+        variants[num_variants].name = memcpy_tune_variant(i)->name;
+        variants[num_variants++].func = memcpy_tune_variant(i)->func;
+    }
+#ifdef __arm__
+    variants[num_variants].name = "aligned_fetch_fbmem_to_scratch_arm";
+    variants[num_variants].func = memcpy_bench_aligned_fetch;
+    variants[num_variants++].aligned_fetch = 1;
+#endif
+    variants[num_variants].name = "memcpy";
+    variants[num_variants++].func = memcpy_bench_libc;
+
+    /* The cached source and the destination */
+    src_area_size[MEMCPY_BENCH_CACHED] = max_size + 2 * MEMCPY_BENCH_MARGIN;
+    if (posix_memalign((void **)&src_area[MEMCPY_BENCH_CACHED], 4096,
+                       src_area_size[MEMCPY_BENCH_CACHED]) != 0 ||
+        posix_memalign((void **)&dst_area, 4096,
+                       max_size + 2 * MEMCPY_BENCH_MARGIN) != 0) {
+        fprintf(stderr, "failed to allocate %d bytes\n", max_size);
+        return 1;
+    }
+    memset(src_area[MEMCPY_BENCH_CACHED], 0x5a,
+           src_area_size[MEMCPY_BENCH_CACHED]);
+    memset(dst_area, 0, max_size + 2 * MEMCPY_BENCH_MARGIN);
+
+    /* The uncached source, which is only read */
+    if (strcmp(device, "none") != 0) {
+        int fd = open(device, O_RDONLY | O_SYNC);
+        struct fb_fix_screeninfo fix;
+        struct stat st;
+        if (fd >= 0) {
+            /* The size of a framebuffer device, or else of a file */
+            if (ioctl(fd, FBIOGET_FSCREENINFO, &fix) == 0)
+                uncached_map_size = fix.smem_len;
+            else if (fstat(fd, &st) == 0)
+                uncached_map_size = st.st_size;
+            if (uncached_map_size > 0)
+                uncached_map = mmap(NULL, uncached_map_size, PROT_READ,
+                                    MAP_SHARED, fd, 0);
+            close(fd);
+        }
+        if (uncached_map == MAP_FAILED)
+            fprintf(stderr, "can't map %s, skipping the uncached source\n",
+                    device);
+        else {
+            src_area[MEMCPY_BENCH_UNCACHED] = uncached_map;
+            src_area_size[MEMCPY_BENCH_UNCACHED] = uncached_map_size;
+        }
+    }
+
+    if (mhz > 0)
+        fprintf(stderr, "CPU clock %.0f MHz\n", mhz);
+    else
+        fprintf(stderr, "unknown CPU clock, use -c for cycles per byte\n");
+
+    fprintf(out, "variant,source,size,src_align,dst_align,mbytes_per_sec,"
+            "cycles_per_byte\n");
+
+    for (i = 0; i < num_variants; i++) {
+        const memcpy_bench_variant_t *variant = &variants[i];
+        if (filter && !strstr(variant->name, filter))
+            continue;
+        fprintf(stderr, "%s\n", variant->name);
+
+        for (source = 0; source < MEMCPY_BENCH_NUM_SOURCES; source++) {
+            if (!src_area[source])
+                continue;
+            for (size = min_size; size <= max_size; size *= 2) {
+                if ((size_t)size + 2 * MEMCPY_BENCH_MARGIN >
+                    src_area_size[source])
+                    break;
+                if (variant->aligned_fetch && size < 32)
+                    continue;
+                for (src_align = 0; src_align < 32; src_align++) {
+                    for (dst_align = 0; dst_align < 32; dst_align++) {
+                        double bandwidth;
+                        if (!all_dst_aligns && dst_align > 0)
+                            break;
+                        if (variant->aligned_fetch &&
+                            (src_align > 0 || dst_align > 0))
+                            break;
+                        bandwidth = memcpy_bench_measure(variant->func,
+                            dst_area + MEMCPY_BENCH_MARGIN + dst_align,
+                            src_area[source] + MEMCPY_BENCH_MARGIN + src_align,
+                            size, min_time, runs);
+                        fprintf(out, "%s,%s,%d,%d,%d,%.3f,", variant->name,
+                                memcpy_bench_source_names[source], size,
+                                src_align, dst_align, bandwidth / 1000000);
+                        if (mhz > 0)
+                            fprintf(out, "%.4f", mhz * 1000000 / bandwidth);
+                        fprintf(out, "\n");
+                    }
+                }
+                fflush(out);
+                if (size > INT32_MAX / 2)
+                    break;
+            }
+        }
+    }
+
+    if (out != stdout)
+        fclose(out);
+    if (uncached_map != MAP_FAILED)
+        munmap(uncached_map, uncached_map_size);
+    free(dst_area);
+    free(src_area[MEMCPY_BENCH_CACHED]);
+    free(variants);
+    return 0;
+}
@@ -0,0 +1,434 @@
+/*
+ * Copyright © 2013 The xf86-video-rpifb authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Replay a trace recorded with Option "TraceFile" against a memory-backed
+ * framebuffer, without an X server.
+ *
+ * Every box of the trace is fed through the same fallback chain as in
+ * rpi_x.c (see bench_chain.h), for the selected AccelMethod. Offscreen pixmaps and client images are ordinary heap buffers
+ * which are large enough for the boxes of each record; their contents are
+ * not part of the trace, so only the timing is meaningful.
+ *
+ * Results are written as JSON.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <inttypes.h>
+#include <pixman.h>
+
+#include "cpu_backend.h"
+#include "rpi_disp.h"
+#include "rpi_stats.h"
+#include "rpi_trace.h"
+#include "bench_chain.h"
+
+/* A heap buffer standing in for a pixmap or a client image */
+typedef struct {
+    uint32_t *bits;
+    size_t    size;   /* in bytes */
+    int       stride; /* in 32-bit words */
+} replay_buffer_t;
+
+typedef struct {
+    /* The trace, loaded into memory */
+    rpi_trace_header_t header;
+    uint8_t           *data;
+    size_t             data_size;
+
+    /* The memory-backed framebuffer and the backends */
+    uint32_t          *fb_bits;
+    int                fb_stride;
+    size_t             fb_size;
+    rpi_disp_t        *disp;
+    cpu_backend_t     *cpu_backend;
+
+    bench_chain_t      chain;
+
+    replay_buffer_t    src_pixmap;
+    replay_buffer_t    dst_pixmap;
+
+    rpi_stats_t       *stats;
+    long               records[RPI_STATS_NUM_OPS];
+    long               boxes[RPI_STATS_NUM_OPS];
+    double             seconds[RPI_STATS_NUM_OPS];
+} replay_t;
+
+static double
+replay_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int
+replay_load(replay_t *replay, const char *filename)
+{
+    FILE *f = fopen(filename, "rb");
+    long size;
+
+    if (!f) {
+        perror(filename);
+        return 0;
+    }
+    if (fread(&replay->header, sizeof(replay->header), 1, f) != 1 ||
+        replay->header.magic != RPI_TRACE_MAGIC ||
+        replay->header.version != RPI_TRACE_VERSION)
+    {
+        fprintf(stderr, "%s: not a trace file of this version\n", filename);
+        fclose(f);
+        return 0;
+    }
+
+    fseek(f, 0, SEEK_END);
+    size = ftell(f) - sizeof(replay->header);
+    fseek(f, sizeof(replay->header), SEEK_SET);
+    replay->data = malloc(size > 0 ? size : 1);
+    if (!replay->data || fread(replay->data, 1, size, f) != (size_t)size) {
+        fprintf(stderr, "%s: failed to read the trace\n", filename);
+        fclose(f);
+        return 0;
+    }
+    replay->data_size = size;
+    fclose(f);
+    return 1;
+}
+
+/* Make sure the buffer can hold width x height pixels */
+static uint32_t *
+replay_buffer(replay_buffer_t *buffer, int width, int height, int bpp)
+{
+    int stride = (width * bpp + 31) / 32;
+    size_t size = (size_t)stride * height * 4;
+
+    if (size > buffer->size) {
+        free(buffer->bits);
+        if (posix_memalign((void **)&buffer->bits, 4096, size) != 0) {
+            buffer->bits = NULL;
+            buffer->size = 0;
+            return NULL;
+        }
+        memset(buffer->bits, 0x22, size);
+        buffer->size = size;
+    }
+    buffer->stride = stride;
+    return buffer->bits;
+}
+
+/*
+ * Set up the destination buffer of a record. The framebuffer has the size
+ * of the screen, a pixmap is made large enough for all the boxes.
+ */
+static int
+replay_destination(replay_t *replay, const rpi_trace_record_t *record,
+                   const rpi_trace_box_t *boxes, uint32_t **bits,
+                   int *stride, int *width, int *height)
+{
+    int i;
+
+    if (record->dst_kind == RPI_TRACE_KIND_FRAMEBUFFER) {
+        *bits = replay->fb_bits;
+        *stride = replay->fb_stride;
+        *width = replay->header.width;
+        *height = replay->header.height;
+        return 1;
+    }
+
+    *width = *height = 1;
+    for (i = 0; i < record->nbox; i++) {
+        if (boxes[i].x2 > *width)
+            *width = boxes[i].x2;
+        if (boxes[i].y2 > *height)
+            *height = boxes[i].y2;
+    }
+    /* A copy within the same pixmap */
+    if (record->src_kind == RPI_TRACE_KIND_PIXMAP) {
+        if (record->src_width > *width)
+            *width = record->src_width;
+        if (record->src_height > *height)
+            *height = record->src_height;
+    }
+    *bits = replay_buffer(&replay->dst_pixmap, *width, *height, record->bpp);
+    *stride = replay->dst_pixmap.stride;
+    return *bits != NULL;
+}
+
+static void
+replay_record(replay_t *replay, const rpi_trace_record_t *record,
+              const rpi_trace_box_t *boxes)
+{
+    uint32_t *dst, *src = NULL;
+    int dst_stride, dst_width, dst_height;
+    int src_stride = 0;
+    int reverse = (record->flags & RPI_TRACE_FLAG_REVERSE) != 0;
+    int upsidedown = (record->flags & RPI_TRACE_FLAG_UPSIDEDOWN) != 0;
+    int bpp = record->bpp;
+    double start;
+    int i;
+
+    if (!replay_destination(replay, record, boxes, &dst, &dst_stride,
+                            &dst_width, &dst_height))
+        return;
+
+    switch (record->src_kind) {
+    case RPI_TRACE_KIND_FRAMEBUFFER:
+        src = replay->fb_bits;
+        src_stride = replay->fb_stride;
+        break;
+    case RPI_TRACE_KIND_PIXMAP:
+        if (record->dst_kind == RPI_TRACE_KIND_PIXMAP &&
+            (reverse || upsidedown)) {
+            /* overlapping copy within the same pixmap */
+            src = dst;
+            src_stride = dst_stride;
+            break;
+        }
+        /* fall through */
+    case RPI_TRACE_KIND_IMAGE:
+        src = replay_buffer(&replay->src_pixmap, record->src_width,
+                            record->src_height, bpp);
+        src_stride = replay->src_pixmap.stride;
+        if (!src)
+            return;
+        break;
+    }
+
+    start = replay_time();
+    for (i = 0; i < record->nbox; i++) {
+        const rpi_trace_box_t *box = &boxes[i];
+        int w = box->x2 - box->x1;
+        int h = box->y2 - box->y1;
+        int stage;
+
+        /* The trace may come from a different mode, skip what doesn't fit */
+        if (box->x1 < 0 || box->y1 < 0 || w <= 0 || h <= 0 ||
+            box->x2 > dst_width || box->y2 > dst_height)
+            continue;
+
+        switch (record->op) {
+        case RPI_STATS_OP_COPY_AREA:
+        case RPI_STATS_OP_COPY_WINDOW:
+            stage = bench_chain_copy(&replay->chain, record->op, src, dst, src_stride,
+                                dst_stride, bpp, box->x1 + record->dx,
+                                box->y1 + record->dy, box->x1, box->y1,
+                                w, h, reverse, upsidedown);
+            break;
+        case RPI_STATS_OP_PUT_IMAGE:
+            stage = bench_chain_put_image(&replay->chain, src, dst,
+                                          src_stride, dst_stride, bpp,
+                                          box->x1 + record->dx,
+                                          box->y1 + record->dy,
+                                          box->x1, box->y1, w, h);
+            break;
+        case RPI_STATS_OP_POLY_FILL_RECT:
+            stage = bench_chain_fill(&replay->chain, dst, dst_stride, bpp,
+                                     box->x1, box->y1, w, h, record->color);
+            break;
+        default:
+            continue;
+        }
+        rpi_stats_count(replay->stats, record->op, stage, w, h, bpp);
+        replay->boxes[record->op]++;
+    }
+    replay->seconds[record->op] += replay_time() - start;
+    replay->records[record->op]++;
+}
+
+/* Returns 0 if the trace is truncated or corrupt */
+static int
+replay_all(replay_t *replay)
+{
+    uint8_t *p = replay->data;
+    uint8_t *end = replay->data + replay->data_size;
+
+    while (p + sizeof(rpi_trace_record_t) <= end) {
+        rpi_trace_record_t record;
+        memcpy(&record, p, sizeof(record));
+        p += sizeof(record);
+        if (p + record.nbox * sizeof(rpi_trace_box_t) > end ||
+            record.op >= RPI_STATS_NUM_OPS)
+            return 0;
+        if (record.bpp == replay->header.bpp)
+            replay_record(replay, &record, (const rpi_trace_box_t *)p);
+        p += record.nbox * sizeof(rpi_trace_box_t);
+    }
+    return p == end;
+}
+
+static void
+replay_report(replay_t *replay, FILE *out, const char *trace,
+              const char *accel, int iterations)
+{
+    int op, stage, reason, bpp, bucket, n = 0;
+
+    fprintf(out, "{\n  \"trace\": \"%s\",\n  \"processor\": \"%s\",\n"
+            "  \"accel\": \"%s\",\n  \"iterations\": %d,\n"
+            "  \"framebuffer\": {\"width\": %d, \"height\": %d, \"bpp\": %d},\n"
+            "  \"ops\": [",
+            trace, replay->cpu_backend->cpuinfo ?
+                replay->cpu_backend->cpuinfo->processor_name : "Unknown",
+            accel, iterations, replay->header.width, replay->header.height,
+            replay->header.bpp);
+    for (op = 0; op < RPI_STATS_NUM_OPS; op++) {
+        fprintf(out, "%s\n    {\"op\": \"%s\", \"records\": %ld, "
+                "\"boxes\": %ld, \"seconds\": %.6f}",
+                op ? "," : "", rpi_stats_op_names[op], replay->records[op],
+                replay->boxes[op], replay->seconds[op]);
+    }
+    fprintf(out, "\n  ],\n  \"dispatch\": [");
+    for (op = 0; op < RPI_STATS_NUM_OPS; op++) {
+        for (stage = 0; stage < RPI_STATS_NUM_STAGES; stage++) {
+            rpi_stats_counter_t *c = &replay->stats->dispatch[op][stage];
+            if (c->calls == 0)
+                continue;
+            fprintf(out, "%s\n    {\"op\": \"%s\", \"stage\": \"%s\", "
+                    "\"calls\": %" PRIu64 ", \"pixels\": %" PRIu64 ", "
+                    "\"bytes\": %" PRIu64 "}",
+                    n++ ? "," : "", rpi_stats_op_names[op],
+                    rpi_stats_stage_names[stage], c->calls, c->pixels,
+                    c->bytes);
+        }
+    }
+    fprintf(out, "\n  ],\n  \"fallbacks\": [");
+    n = 0;
+    for (reason = 0; reason < RPI_STATS_NUM_REASONS; reason++) {
+        for (bpp = 0; bpp < RPI_STATS_NUM_BPP; bpp++) {
+            uint64_t total = 0;
+            for (bucket = 0; bucket < RPI_STATS_NUM_SIZE_BUCKETS; bucket++)
+                total += replay->stats->fallbacks[reason][bpp][bucket];
+            if (total == 0)
+                continue;
+            fprintf(out, "%s\n    {\"reason\": \"%s\", \"bpp\": \"%s\", "
+                    "\"count\": %" PRIu64 "}", n++ ? "," : "",
+                    rpi_stats_reason_names[reason], rpi_stats_bpp_names[bpp],
+                    total);
+        }
+    }
+    fprintf(out, "\n  ]\n}\n");
+}
+
+static void
+usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [-a rpi|none] [-n iterations] [-o file] trace\n"
+            "  -a method      replay as with the given AccelMethod (default rpi)\n"
+            "  -n iterations  replay the trace this many times (default 1)\n"
+            "  -o file        write the JSON results to file instead of stdout\n",
+            name);
+}
+
+int
+main(int argc, char *argv[])
+{
+    replay_t replay;
+    const char *accel = "rpi";
+    FILE *out = stdout;
+    void *fb_mem;
+    int iterations = 1;
+    int c, i;
+
+    memset(&replay, 0, sizeof(replay));
+
+    while ((c = getopt(argc, argv, "a:n:o:h")) != -1) {
+        switch (c) {
+        case 'a':
+            accel = optarg;
+            if (strcmp(accel, "rpi") != 0 && strcmp(accel, "none") != 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        case 'o':
+            out = fopen(optarg, "w");
+            if (!out) {
+                perror(optarg);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (!replay_load(&replay, argv[optind]))
+        return 1;
+
+    replay.fb_stride = (replay.header.width * replay.header.bpp + 31) / 32;
+    replay.fb_size = (size_t)replay.fb_stride * replay.header.height * 4;
+    if (posix_memalign(&fb_mem, 4096, replay.fb_size) != 0) {
+        fprintf(stderr, "failed to allocate the framebuffer\n");
+        return 1;
+    }
+    memset(fb_mem, 0x11, replay.fb_size);
+    replay.fb_bits = fb_mem;
+
+    replay.stats = calloc(sizeof(rpi_stats_t), 1);
+    replay.cpu_backend = cpu_backend_init(fb_mem, replay.fb_size);
+    replay.disp = rpi_disp_init_memory(fb_mem, replay.header.width,
+                                       replay.header.height,
+                                       replay.header.bpp, replay.fb_size);
+    if (!replay.stats || !replay.cpu_backend || !replay.disp) {
+        fprintf(stderr, "failed to initialize the backends\n");
+        return 1;
+    }
+    /* let the backends record why they decline requests */
+    replay.cpu_backend->stats = replay.stats;
+    replay.disp->stats = replay.stats;
+
+    bench_chain_init(&replay.chain, accel, replay.disp, replay.cpu_backend);
+
+    for (i = 0; i < iterations; i++) {
+        if (!replay_all(&replay)) {
+            fprintf(stderr, "%s: the trace is truncated or corrupt\n",
+                    argv[optind]);
+            break;
+        }
+    }
+
+    replay_report(&replay, out, argv[optind], accel, iterations);
+    if (out != stdout)
+        fclose(out);
+
+    rpi_disp_close(replay.disp);
+    cpu_backend_close(replay.cpu_backend);
+    free(replay.src_pixmap.bits);
+    free(replay.dst_pixmap.bits);
+    free(replay.stats);
+    free(replay.data);
+    free(fb_mem);
+    return 0;
+}
@@ -0,0 +1,337 @@
+/*
+ * Copyright © 2013 The xf86-video-rpifb authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Differential fuzzer and benchmark for the two-pass memmove of the CPU
+ * backend (twopass_memmove_arm and twopass_blt_8bpp_arm).
+ *
+ * Every case is a random 2D blit within one arena: overlapping in any
+ * direction or not, with random bpp, widths (including odd ones and widths
+ * just below and above multiples of SCRATCHSIZE), strides and alignments.
+ * The result is compared byte for byte, over the whole arena, against a
+ * reference which copies the source rectangle out first and then writes it
+ * back row by row with memmove. Then the case is timed.
+ *
+ * With -c, the variant for cached memory (cached_blt_8bpp_arm) is checked
+ * instead.
+ *
+ * On other architectures than ARM the portable stand-ins of the assembler
+ * functions are used, which still checks the direction and chunking logic.
+ * Build with -DSCRATCHSIZE=n to try other scratch buffer sizes.
+ *
+ * The cases are written as JSON, one per line. The exit status is 1 if any
+ * case produced a wrong result.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include "cpu_backend.h"
+
+/* The blits stay this far away from both ends of the arena */
+#define TWOPASS_MARGIN     64
+#define TWOPASS_ARENA_SIZE (4 * 1024 * 1024)
+
+typedef struct {
+    int bpp;
+    int width, height;          /* in pixels */
+    int src_stride, dst_stride; /* in bytes */
+    size_t src_offset, dst_offset;
+    int overlap;
+} twopass_case_t;
+
+static double
+twopass_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int
+twopass_random(int n)
+{
+    return n > 0 ? rand() % n : 0;
+}
+
+/* A width in bytes, biased towards the interesting cases */
+static int
+twopass_random_width_bytes(void)
+{
+    switch (twopass_random(4)) {
+    case 0:
+        /* around a multiple of the scratch size */
+        return (1 + twopass_random(3)) * SCRATCHSIZE - 40 + twopass_random(80);
+    case 1:
+        /* small */
+        return 1 + twopass_random(64);
+    default:
+        return 1 + twopass_random(4 * SCRATCHSIZE);
+    }
+}
+
+static void
+twopass_generate(twopass_case_t *c)
+{
+    static const int bpps[] = { 8, 16, 24, 32 };
+    int bytes_pp, width_bytes, max_height;
+    size_t src_size, dst_size, space;
+
+    memset(c, 0, sizeof(*c));
+    c->bpp = bpps[twopass_random(4)];
+    bytes_pp = c->bpp / 8;
+    width_bytes = twopass_random_width_bytes();
+    c->width = width_bytes / bytes_pp > 0 ? width_bytes / bytes_pp : 1;
+    width_bytes = c->width * bytes_pp;
+
+    if (twopass_random(3)) {
+        /*
+         * The destination is the source moved by a few pixels and rows
+         * within one surface. Like in the driver, both rectangles lie
+         * within the rows of the surface.
+         */
+        int dx = (twopass_random(33) - 16) * bytes_pp;
+        int dy = twopass_random(9) - 4;
+        int stride_min = width_bytes + (dx < 0 ? -dx : dx);
+        int src_col;
+        size_t extent;
+
+        c->overlap = 1;
+        c->src_stride = stride_min + twopass_random(256);
+        if (twopass_random(4))
+            c->src_stride = (c->src_stride + 3) & ~3;
+        c->dst_stride = c->src_stride;
+        max_height = (TWOPASS_ARENA_SIZE - 2 * TWOPASS_MARGIN) /
+                     c->src_stride - 4;
+        c->height = 1 + twopass_random(max_height < 64 ? max_height : 64);
+
+        src_col = twopass_random(c->src_stride - stride_min + 1) +
+                  (dx < 0 ? -dx : 0);
+        extent = (size_t)c->src_stride * (c->height + (dy < 0 ? -dy : dy));
+        space = TWOPASS_ARENA_SIZE - 2 * TWOPASS_MARGIN - extent;
+        c->src_offset = TWOPASS_MARGIN + twopass_random(space) +
+                        (size_t)c->src_stride * (dy < 0 ? -dy : 0) + src_col;
+        c->dst_offset = c->src_offset + (long)dy * c->src_stride + dx;
+        return;
+    }
+
+    /* Mostly 32-bit aligned strides like in the driver, sometimes not */
+    c->src_stride = width_bytes + twopass_random(256);
+    if (twopass_random(4))
+        c->src_stride = (c->src_stride + 3) & ~3;
+    c->dst_stride = width_bytes + twopass_random(256);
+    if (twopass_random(4))
+        c->dst_stride = (c->dst_stride + 3) & ~3;
+
+    max_height = (TWOPASS_ARENA_SIZE / 2 - 2 * TWOPASS_MARGIN) /
+                 (c->src_stride > c->dst_stride ? c->src_stride
+                                                : c->dst_stride);
+    c->height = 1 + twopass_random(max_height < 64 ? max_height : 64);
+    src_size = (size_t)c->src_stride * (c->height - 1) + width_bytes;
+    dst_size = (size_t)c->dst_stride * (c->height - 1) + width_bytes;
+
+    /* The source and the destination in different halves of the arena */
+    space = TWOPASS_ARENA_SIZE / 2 - TWOPASS_MARGIN - src_size;
+    c->src_offset = TWOPASS_MARGIN + twopass_random(space);
+    space = TWOPASS_ARENA_SIZE / 2 - TWOPASS_MARGIN - dst_size;
+    c->dst_offset = TWOPASS_ARENA_SIZE / 2 + twopass_random(space);
+    if (twopass_random(2)) {
+        size_t offset = c->src_offset;
+        int stride = c->src_stride;
+        c->src_offset = c->dst_offset;
+        c->dst_offset = offset;
+        c->src_stride = c->dst_stride;
+        c->dst_stride = stride;
+    }
+}
+
+static void
+twopass_reference(const twopass_case_t *c, uint8_t *arena, uint8_t *tmp)
+{
+    int width_bytes = c->width * c->bpp / 8;
+    int y;
+
+    for (y = 0; y < c->height; y++)
+        memcpy(tmp + (size_t)y * width_bytes,
+               arena + c->src_offset + (size_t)y * c->src_stride, width_bytes);
+    for (y = 0; y < c->height; y++)
+        memmove(arena + c->dst_offset + (size_t)y * c->dst_stride,
+                tmp + (size_t)y * width_bytes, width_bytes);
+}
+
+static void
+twopass_run(cpu_backend_t *ctx, const twopass_case_t *c, uint8_t *arena,
+            int cached)
+{
+    if (cached)
+        cached_blt_8bpp_arm(ctx, c->width * c->bpp / 8, c->height,
+                            arena + c->dst_offset, c->dst_stride,
+                            arena + c->src_offset, c->src_stride);
+    else
+        twopass_blt_8bpp_arm(ctx, c->width * c->bpp / 8, c->height,
+                             arena + c->dst_offset, c->dst_stride,
+                             arena + c->src_offset, c->src_stride);
+}
+
+static void
+usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [-c] [-n cases] [-s seed] [-t seconds] [-o file]\n"
+            "  -c          check the cached memory variant\n"
+            "  -n cases    the number of random cases (default 1000)\n"
+            "  -s seed     the random seed (default 1)\n"
+            "  -t seconds  time spent timing each case, 0 to only check "
+            "(default 0.001)\n"
+            "  -o file     write the JSON results to file instead of stdout\n",
+            name);
+}
+
+int
+main(int argc, char *argv[])
+{
+    cpu_backend_t *ctx;
+    uint8_t *arena, *expected, *tmp;
+    FILE *out = stdout;
+    double min_time = 0.001;
+    unsigned int seed = 1;
+    int cases = 1000, failures = 0;
+    int cached = 0;
+    int c, i;
+    size_t j;
+
+    while ((c = getopt(argc, argv, "cn:s:t:o:h")) != -1) {
+        switch (c) {
+        case 'c':
+            cached = 1;
+            break;
+        case 'n':
+            cases = atoi(optarg);
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            min_time = atof(optarg);
+            break;
+        case 'o':
+            out = fopen(optarg, "w");
+            if (!out) {
+                perror(optarg);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (posix_memalign((void **)&arena, 4096, TWOPASS_ARENA_SIZE) != 0 ||
+        posix_memalign((void **)&expected, 4096, TWOPASS_ARENA_SIZE) != 0 ||
+        posix_memalign((void **)&tmp, 4096, TWOPASS_ARENA_SIZE) != 0) {
+        fprintf(stderr, "failed to allocate the test buffers\n");
+        return 1;
+    }
+    /* The arena takes the role of the framebuffer */
+    ctx = cpu_backend_init(arena, TWOPASS_ARENA_SIZE);
+    if (!ctx) {
+        fprintf(stderr, "failed to initialize the CPU backend\n");
+        return 1;
+    }
+
+    srand(seed);
+    for (j = 0; j < TWOPASS_ARENA_SIZE; j++)
+        arena[j] = rand();
+
+    fprintf(out, "{\n  \"processor\": \"%s\",\n  \"cached\": %s,\n"
+            "  \"scratchsize\": %d,\n"
+            "  \"seed\": %u,\n  \"cases\": [",
+            ctx->cpuinfo ? ctx->cpuinfo->processor_name : "Unknown",
+            cached ? "true" : "false", SCRATCHSIZE, seed);
+
+    for (i = 0; i < cases; i++) {
+        twopass_case_t tc;
+        size_t mismatch = TWOPASS_ARENA_SIZE;
+        long calls = 0;
+        double start, elapsed = 0;
+        int width_bytes;
+
+        twopass_generate(&tc);
+        width_bytes = tc.width * tc.bpp / 8;
+
+        memcpy(expected, arena, TWOPASS_ARENA_SIZE);
+        twopass_reference(&tc, expected, tmp);
+        twopass_run(ctx, &tc, arena, cached);
+        if (memcmp(expected, arena, TWOPASS_ARENA_SIZE) != 0) {
+            for (j = 0; j < TWOPASS_ARENA_SIZE; j++)
+                if (expected[j] != arena[j])
+                    break;
+            mismatch = j;
+            failures++;
+            fprintf(stderr, "case %d: mismatch at offset %zd from the "
+                    "destination\n", i, (ssize_t)(j - tc.dst_offset));
+            /* Continue from the expected state */
+            memcpy(arena, expected, TWOPASS_ARENA_SIZE);
+        }
+
+        if (min_time > 0) {
+            start = twopass_time();
+            do {
+                twopass_run(ctx, &tc, arena, cached);
+                calls++;
+                elapsed = twopass_time() - start;
+            } while (elapsed < min_time);
+        }
+
+        fprintf(out, "%s\n    {\"case\": %d, \"bpp\": %d, \"width\": %d, "
+                "\"height\": %d, \"src_stride\": %d, \"dst_stride\": %d, "
+                "\"src_align\": %d, \"dst_align\": %d, \"overlap\": %s, "
+                "\"dst_before_src\": %s, \"ok\": %s",
+                i ? "," : "", i, tc.bpp, tc.width, tc.height, tc.src_stride,
+                tc.dst_stride, (int)((uintptr_t)(arena + tc.src_offset) & 31),
+                (int)((uintptr_t)(arena + tc.dst_offset) & 31),
+                tc.overlap ? "true" : "false",
+                tc.dst_offset < tc.src_offset ? "true" : "false",
+                mismatch == TWOPASS_ARENA_SIZE ? "true" : "false");
+        if (calls > 0)
+            fprintf(out, ", \"mbytes_per_sec\": %.3f",
+                    (double)calls * width_bytes * tc.height / elapsed /
+                    1000000.0);
+        fprintf(out, "}");
+    }
+
+    fprintf(out, "\n  ],\n  \"failures\": %d\n}\n", failures);
+    if (out != stdout)
+        fclose(out);
+
+    cpu_backend_close(ctx);
+    free(tmp);
+    free(expected);
+    free(arena);
+    return failures ? 1 : 0;
+}
@@ -25,6 +25,7 @@
  */
 
 #include <stdlib.h>
+#include <limits.h>
 #include <stdio.h> // For debugging.
 #include <string.h>
 
@@ -40,20 +41,73 @@
  */
 #define ARM_BLT_WIDTH_THRESHOLD_32BPP 40
 #define ARM_BLT_WIDTH_THRESHOLD_16BPP 60
+#define ARM_BLT_WIDTH_THRESHOLD_24BPP 48
+#define ARM_BLT_WIDTH_THRESHOLD_8BPP 120
 
-#ifdef __arm__
+/*
+ * The widest row (in bytes) of the boxes taken by fill_boxes_cpu. Wider
+ * fills are left to pixman, which writes them in bursts; the small ones,
+ * like the background of glyphs, are dominated by the call overhead.
+ * pixman has no 24bpp fills, all of them are taken.
+ */
+#define CPU_FILL_MAX_ROW_BYTES 128
+
+/*
+ * The smallest distance between the source and the destination of an
+ * overlapped copy in cached memory, which cached_memmove_arm copies in
+ * chunks of that size rather than through a scratch buffer.
+ */
+#define CACHED_MEMMOVE_MIN_CHUNK 64
 
-#define ARM_MEMCPY_NO_OVERFETCH(dst, src, size) \
-    memcpy_armv5te_no_overfetch(dst, src, size);
+/* The most boxes fill_boxes_cpu sorts and merges at once */
+#define CPU_FILL_BATCH_SIZE 64
 
-#define ARM_MEMCPY(dst, src, size) \
-    memcpy_armv5te_overfetch(dst, src, size);
+/*
+ * The memcpy functions are looked up in the dispatch tables of the backend,
+ * by the kind of memory of the source and the size of the copy.
+ */
+#define ARM_MEMCPY_NO_OVERFETCH(ctx, source, dst, src, size) \
+    (ctx)->memcpy_no_overfetch[source][cpu_memcpy_size_class(size)](dst, src, size);
+
+#define ARM_MEMCPY(ctx, source, dst, src, size) \
+    (ctx)->memcpy_overfetch[source][cpu_memcpy_size_class(size)](dst, src, size);
+
+#ifdef __arm__
 
 /* Macro for the ARM cache line preload instruction. */
 #define ARM_PRELOAD(_var, _offset)\
     asm volatile ("pld [%[address], %[offset]]" : : [address] "r" (_var), [offset] "I" (_offset));
 
-static void writeback_scratch_to_mem_arm(int size, void *dst, const void *src);
+#define ALIGNED_FETCH_FBMEM_TO_SCRATCH aligned_fetch_fbmem_to_scratch_arm
+#define DEFAULT_MEMCPY_NO_OVERFETCH memcpy_armv5te_no_overfetch
+#define DEFAULT_MEMCPY_OVERFETCH memcpy_armv5te_overfetch
+
+#else
+
+/*
+ * Portable stand-ins for the assembler functions, so that the two-pass
+ * memmove below can be exercised on any host (see bench/rpifb_twopass.c).
+ */
+static void
+aligned_fetch_fbmem_to_scratch_c(int size, void *dst, const void *src)
+{
+    memcpy(dst, src, (size + 31) & ~31);
+}
+
+static void *
+memcpy_c(void *dst, const void *src, int size)
+{
+    return memcpy(dst, src, size);
+}
+
+#define ALIGNED_FETCH_FBMEM_TO_SCRATCH aligned_fetch_fbmem_to_scratch_c
+#define DEFAULT_MEMCPY_NO_OVERFETCH memcpy_c
+#define DEFAULT_MEMCPY_OVERFETCH memcpy_c
+
+#endif
+
+static void writeback_scratch_to_mem_arm(cpu_backend_t *ctx, int size,
+                                         void *dst, const void *src);
 
 /*
  * Optimized assembler version of aligned_fetch_fbmem_to_scratch_arm is provided
@@ -63,12 +117,11 @@ static void writeback_scratch_to_mem_arm(int size, void *dst, const void *src);
 
 /* This module uses optimized assembler memcpy function defined in arm_asm.S. */
 
-static void writeback_scratch_to_mem_arm(int size, void *dst, const void *src) {
-    ARM_MEMCPY_NO_OVERFETCH(dst, src, size);
+static void writeback_scratch_to_mem_arm(cpu_backend_t *ctx, int size,
+                                         void *dst, const void *src) {
+    ARM_MEMCPY_NO_OVERFETCH(ctx, CPU_MEMCPY_SRC_CACHED, dst, src, size);
 }
 
-#define SCRATCHSIZE 2048
-
 /*
  * This is a function similar to memmove, which tries to minimize uncached read
  * penalty for the source buffer (for example if the source is a framebuffer).
@@ -78,8 +131,9 @@ static void writeback_scratch_to_mem_arm(int size, void *dst, const void *src) {
  * (even if an aligned 32 byte chunk contains only a single byte belonging
  * to the source buffer, the whole chunk is going to be read).
  */
-static void
-twopass_memmove_arm(void *dst_, const void *src_, size_t size)
+void
+twopass_memmove_arm(cpu_backend_t *ctx, void *dst_, const void *src_,
+                    size_t size)
 {
     uint8_t tmpbuf[SCRATCHSIZE + 32 + 31];
     uint8_t *scratchbuf = (uint8_t *)((uintptr_t)(&tmpbuf[0] + 31) & ~31);
@@ -90,17 +144,17 @@ twopass_memmove_arm(void *dst_, const void *src_, size_t size)
 
     if (src > dst) {
         while (size >= SCRATCHSIZE) {
-            aligned_fetch_fbmem_to_scratch_arm(SCRATCHSIZE + extrasize,
+            ALIGNED_FETCH_FBMEM_TO_SCRATCH(SCRATCHSIZE + extrasize,
                                                 scratchbuf, src - alignshift);
-            writeback_scratch_to_mem_arm(SCRATCHSIZE, dst, scratchbuf + alignshift);
+            writeback_scratch_to_mem_arm(ctx, SCRATCHSIZE, dst, scratchbuf + alignshift);
             size -= SCRATCHSIZE;
             dst += SCRATCHSIZE;
             src += SCRATCHSIZE;
         }
         if (size > 0) {
-            aligned_fetch_fbmem_to_scratch_arm(size + extrasize,
+            ALIGNED_FETCH_FBMEM_TO_SCRATCH(size + extrasize,
                                                 scratchbuf, src - alignshift);
-            writeback_scratch_to_mem_arm(size, dst, scratchbuf + alignshift);
+            writeback_scratch_to_mem_arm(ctx, size, dst, scratchbuf + alignshift);
         }
     }
     else {
@@ -109,23 +163,24 @@ twopass_memmove_arm(void *dst_, const void *src_, size_t size)
         src += size - remainder;
         size -= remainder;
         if (remainder) {
-            aligned_fetch_fbmem_to_scratch_arm(remainder + extrasize,
+            ALIGNED_FETCH_FBMEM_TO_SCRATCH(remainder + extrasize,
                                                 scratchbuf, src - alignshift);
-            writeback_scratch_to_mem_arm(remainder, dst, scratchbuf + alignshift);
+            writeback_scratch_to_mem_arm(ctx, remainder, dst, scratchbuf + alignshift);
         }
         while (size > 0) {
             dst -= SCRATCHSIZE;
             src -= SCRATCHSIZE;
             size -= SCRATCHSIZE;
-            aligned_fetch_fbmem_to_scratch_arm(SCRATCHSIZE + extrasize,
+            ALIGNED_FETCH_FBMEM_TO_SCRATCH(SCRATCHSIZE + extrasize,
                                                 scratchbuf, src - alignshift);
-            writeback_scratch_to_mem_arm(SCRATCHSIZE, dst, scratchbuf + alignshift);
+            writeback_scratch_to_mem_arm(ctx, SCRATCHSIZE, dst, scratchbuf + alignshift);
         }
     }
 }
 
-static void
-twopass_blt_8bpp_arm(int        width,
+void
+twopass_blt_8bpp_arm(cpu_backend_t *ctx,
+                      int        width,
                       int        height,
                       uint8_t   *dst_bytes,
                       uintptr_t  dst_stride,
@@ -143,7 +198,7 @@ twopass_blt_8bpp_arm(int        width,
         {
             while (--height >= 0)
             {
-                twopass_memmove_arm(dst_bytes, src_bytes, width);
+                twopass_memmove_arm(ctx, dst_bytes, src_bytes, width);
                 dst_bytes += dst_stride;
                 src_bytes += src_stride;
             }
@@ -152,12 +207,395 @@ twopass_blt_8bpp_arm(int        width,
     }
     while (--height >= 0)
     {
-        twopass_memmove_arm(dst_bytes, src_bytes, width);
+        twopass_memmove_arm(ctx, dst_bytes, src_bytes, width);
+        dst_bytes += dst_stride;
+        src_bytes += src_stride;
+    }
+}
+
+/*
+ * A memmove for cached memory (offscreen pixmaps). When the destination
+ * overlaps the source, the row is copied in chunks as long as the distance
+ * between them, backwards when the destination is after the source, so
+ * that no chunk overlaps its own source and the forward memcpy variants
+ * can be used. Distances below CACHED_MEMMOVE_MIN_CHUNK would make too
+ * small chunks, then the chunks go through a scratch buffer instead.
+ */
+void
+cached_memmove_arm(cpu_backend_t *ctx, void *dst_, const void *src_,
+                   size_t size)
+{
+    uint8_t tmpbuf[SCRATCHSIZE + 31];
+    uint8_t *scratchbuf = (uint8_t *)((uintptr_t)(&tmpbuf[0] + 31) & ~31);
+    uint8_t *dst = (uint8_t *)dst_;
+    const uint8_t *src = (const uint8_t *)src_;
+    size_t shift = dst > src ? dst - src : src - dst;
+    size_t chunk = shift;
+    int scratch = 0;
+
+    if (shift >= size) {
+        ARM_MEMCPY_NO_OVERFETCH(ctx, CPU_MEMCPY_SRC_CACHED, dst, src, size);
+        return;
+    }
+    if (chunk < CACHED_MEMMOVE_MIN_CHUNK) {
+        chunk = SCRATCHSIZE;
+        scratch = 1;
+    }
+
+    while (size > 0) {
+        size_t n = size < chunk ? size : chunk;
+        uint8_t *d = dst;
+        const uint8_t *s = src;
+        if (dst > src) {
+            d += size - n;
+            s += size - n;
+        } else {
+            dst += n;
+            src += n;
+        }
+        if (scratch) {
+            ARM_MEMCPY_NO_OVERFETCH(ctx, CPU_MEMCPY_SRC_CACHED, scratchbuf, s, n);
+            ARM_MEMCPY_NO_OVERFETCH(ctx, CPU_MEMCPY_SRC_CACHED, d, scratchbuf, n);
+        } else {
+            ARM_MEMCPY_NO_OVERFETCH(ctx, CPU_MEMCPY_SRC_CACHED, d, s, n);
+        }
+        size -= n;
+    }
+}
+
+/* The rows are walked in the same order as in twopass_blt_8bpp_arm */
+void
+cached_blt_8bpp_arm(cpu_backend_t *ctx,
+                    int        width,
+                    int        height,
+                    uint8_t   *dst_bytes,
+                    uintptr_t  dst_stride,
+                    uint8_t   *src_bytes,
+                    uintptr_t  src_stride)
+{
+    if (src_bytes < dst_bytes + width &&
+        src_bytes + src_stride * height > dst_bytes)
+    {
+        src_bytes += src_stride * height - src_stride;
+        dst_bytes += dst_stride * height - dst_stride;
+        dst_stride = -dst_stride;
+        src_stride = -src_stride;
+    }
+    while (--height >= 0)
+    {
+        cached_memmove_arm(ctx, dst_bytes, src_bytes, width);
         dst_bytes += dst_stride;
         src_bytes += src_stride;
     }
 }
 
+/*
+ * Raster operations, in the form used by fb: the result of an operation
+ * is (dst & ((src & ca1) ^ cx1)) ^ ((src & ca2) ^ cx2). The planemask is
+ * folded in, so that the bits outside of it keep the destination.
+ */
+typedef struct {
+    int      alu;
+    uint32_t ca1, cx1, ca2, cx2;
+    uint32_t planemask;
+    int      uses_source;
+} cpu_rop_t;
+
+static void
+cpu_rop_init(cpu_rop_t *rop, int alu, uint32_t planemask)
+{
+    /*
+     * Bit 3 of alu is the result for src = 0 and dst = 0, bit 2 for 0 and 1,
+     * bit 1 for 1 and 0 and bit 0 for 1 and 1.
+     */
+    uint32_t r00 = (alu & 8) ? ~0U : 0;
+    uint32_t r01 = (alu & 4) ? ~0U : 0;
+    uint32_t r10 = (alu & 2) ? ~0U : 0;
+    uint32_t r11 = (alu & 1) ? ~0U : 0;
+
+    rop->alu = alu;
+    rop->cx1 = r00 ^ r01;
+    rop->ca1 = r00 ^ r01 ^ r10 ^ r11;
+    rop->cx2 = r00;
+    rop->ca2 = r00 ^ r10;
+    rop->planemask = planemask;
+    rop->uses_source = rop->ca1 || rop->ca2;
+}
+
+/* The values of the X raster operations (from X.h) */
+#define GXAND          0x1
+#define GXXOR          0x6
+#define GXOR           0x7
+#define GXCOPYINVERTED 0xc
+
+#define CPU_ROP_LOOP(type, expr)                                            \
+    do {                                                                    \
+        type *d = (type *)dst;                                              \
+        const type *s = (const type *)src;                                  \
+        int n = size / sizeof(type);                                        \
+        while (n-- > 0) {                                                   \
+            type sv = *s++;                                                 \
+            *d = (expr);                                                    \
+            d++;                                                            \
+        }                                                                   \
+    } while (0)
+
+/*
+ * The operations which don't read the source (GXclear, GXnoop, GXinvert
+ * and GXset) only combine the destination with constants.
+ */
+#define CPU_ROP_DST_LOOP(type, and, xor)                                    \
+    do {                                                                    \
+        type *d = (type *)dst;                                              \
+        int n = size / sizeof(type);                                        \
+        while (n-- > 0) {                                                   \
+            *d = (*d & (and)) ^ (xor);                                      \
+            d++;                                                            \
+        }                                                                   \
+    } while (0)
+
+/* The common operations with a full planemask get their own loops */
+#define CPU_ROP_ROW(type, full)                                             \
+    do {                                                                    \
+        type pm = rop->planemask, ca1 = rop->ca1, cx1 = rop->cx1;          \
+        type ca2 = rop->ca2, cx2 = rop->cx2;                                \
+        if (!rop->uses_source) {                                            \
+            CPU_ROP_DST_LOOP(type, cx1 | ~pm, cx2 & pm);                    \
+            break;                                                          \
+        }                                                                   \
+        switch (pm == (type)(full) ? rop->alu : -1) {                       \
+        case GXAND:                                                         \
+            CPU_ROP_LOOP(type, *d & sv);                                    \
+            break;                                                          \
+        case GXOR:                                                          \
+            CPU_ROP_LOOP(type, *d | sv);                                    \
+            break;                                                          \
+        case GXXOR:                                                         \
+            CPU_ROP_LOOP(type, *d ^ sv);                                    \
+            break;                                                          \
+        case GXCOPYINVERTED:                                                \
+            CPU_ROP_LOOP(type, ~sv);                                        \
+            break;                                                          \
+        default:                                                            \
+            CPU_ROP_LOOP(type, (*d & (((sv & ca1) ^ cx1) | ~pm)) ^         \
+                               (((sv & ca2) ^ cx2) & pm));                  \
+            break;                                                          \
+        }                                                                   \
+    } while (0)
+
+/* src isn't read, and may be NULL, for the operations without a source */
+static void
+cpu_rop_row(const cpu_rop_t *rop, int bpp, uint8_t *dst, const uint8_t *src,
+            size_t size)
+{
+    if (bpp == 32)
+        CPU_ROP_ROW(uint32_t, 0xFFFFFFFF);
+    else if (bpp == 16)
+        CPU_ROP_ROW(uint16_t, 0xFFFF);
+    else
+        CPU_ROP_ROW(uint8_t, 0xFF);
+}
+
+/*
+ * The counterpart of twopass_memmove_arm for the raster operations: the
+ * source is read into the scratch buffer (with the aligned fetch when it
+ * is uncached) and then combined with the destination, in chunks walked
+ * in the direction which keeps overlapped rows correct.
+ */
+static void
+rop_memmove_arm(cpu_backend_t *ctx, const cpu_rop_t *rop, int bpp,
+                int uncached, uint8_t *dst, const uint8_t *src, size_t size)
+{
+    uint8_t tmpbuf[SCRATCHSIZE + 32 + 31];
+    uint8_t *scratchbuf = (uint8_t *)((uintptr_t)(&tmpbuf[0] + 31) & ~31);
+
+    while (size > 0) {
+        size_t n = size < SCRATCHSIZE ? size : SCRATCHSIZE;
+        uint8_t *d = dst;
+        const uint8_t *s = src;
+        uintptr_t alignshift, extrasize;
+        if (src > dst) {
+            dst += n;
+            src += n;
+        } else {
+            d += size - n;
+            s += size - n;
+        }
+        alignshift = (uintptr_t)s & 31;
+        extrasize = (alignshift == 0) ? 0 : 32;
+        if (rop->uses_source) {
+            if (uncached)
+                ALIGNED_FETCH_FBMEM_TO_SCRATCH(n + extrasize, scratchbuf,
+                                               s - alignshift);
+            else
+                ARM_MEMCPY_NO_OVERFETCH(ctx, CPU_MEMCPY_SRC_CACHED,
+                                        scratchbuf + alignshift, s, n);
+            cpu_rop_row(rop, bpp, d, scratchbuf + alignshift, n);
+        } else
+            cpu_rop_row(rop, bpp, d, NULL, n);
+        size -= n;
+    }
+}
+
+static int
+rop_blt_cpu(void     *self,
+            uint32_t *src_bits,
+            uint32_t *dst_bits,
+            int       src_stride,
+            int       dst_stride,
+            int       src_bpp,
+            int       dst_bpp,
+            int       src_x,
+            int       src_y,
+            int       dst_x,
+            int       dst_y,
+            int       width,
+            int       height,
+            int       alu,
+            uint32_t  planemask)
+{
+    cpu_backend_t *ctx = (cpu_backend_t *)self;
+    int bpp = src_bpp >> 3;
+    uintptr_t src_stride_bytes = (uintptr_t) src_stride * 4;
+    uintptr_t dst_stride_bytes = (uintptr_t) dst_stride * 4;
+    uint8_t *src_bytes = (uint8_t *)src_bits +
+                         (uintptr_t) src_y * src_stride_bytes +
+                         (uintptr_t) src_x * bpp;
+    uint8_t *dst_bytes = (uint8_t *)dst_bits +
+                         (uintptr_t) dst_y * dst_stride_bytes +
+                         (uintptr_t) dst_x * bpp;
+    int uncached = (src_bytes >= ctx->uncached_area_begin) &&
+                   (src_bytes < ctx->uncached_area_end);
+    uintptr_t row_bytes = (uintptr_t) width * bpp;
+    cpu_rop_t rop;
+
+    if (src_bpp != dst_bpp ||
+        (src_bpp != 8 && src_bpp != 16 && src_bpp != 32)) {
+        RPI_STATS_FALLBACK(ctx->stats, RPI_STATS_REASON_BPP_MISMATCH,
+                           src_bpp, width, height);
+        return 0;
+    }
+    if (src_stride < 0 || dst_stride < 0) {
+        RPI_STATS_FALLBACK(ctx->stats, RPI_STATS_REASON_NEGATIVE_STRIDE,
+                           src_bpp, width, height);
+        return 0;
+    }
+
+    cpu_rop_init(&rop, alu, planemask);
+
+    /* The rows are walked in the same order as in twopass_blt_8bpp_arm */
+    if (src_bytes < dst_bytes + row_bytes &&
+        src_bytes + src_stride_bytes * height > dst_bytes)
+    {
+        src_bytes += src_stride_bytes * height - src_stride_bytes;
+        dst_bytes += dst_stride_bytes * height - dst_stride_bytes;
+        dst_stride_bytes = -dst_stride_bytes;
+        src_stride_bytes = -src_stride_bytes;
+    }
+    while (--height >= 0)
+    {
+        rop_memmove_arm(ctx, &rop, src_bpp, uncached, dst_bytes, src_bytes,
+                        row_bytes);
+        dst_bytes += dst_stride_bytes;
+        src_bytes += src_stride_bytes;
+    }
+    return 1;
+}
+
+#ifdef __arm__
+
+/* How overlapped_blt_arm does a copy */
+enum {
+    CPU_BLT_DECLINE,
+    CPU_BLT_TWOPASS, /* the source is in the uncached area */
+    CPU_BLT_CACHED   /* within one buffer in cached memory */
+};
+
+/* pixman_blt only copies 16 and 32bpp pixels */
+static inline int
+pixman_blt_bpp_ok(int bpp)
+{
+    return bpp == 16 || bpp == 32;
+}
+
+/*
+ * The checks of overlapped_blt_arm which only depend on the buffers and
+ * formats, the box list variant does them once for all the boxes. Copies
+ * between different buffers in cached memory are left to pixman, only the
+ * copies within one buffer, which may need to go backwards or bottom-up
+ * and otherwise end up in fbBlt, are taken. pixman can't copy 8 and
+ * 24bpp pixels, so these are taken between any buffers.
+ */
+static int
+overlapped_blt_check_arm(cpu_backend_t *ctx,
+                         uint32_t      *src_bits,
+                         uint32_t      *dst_bits,
+                         int            src_stride,
+                         int            dst_stride,
+                         int            src_bpp,
+                         int            dst_bpp,
+                         int            width,
+                         int            height)
+{
+    uint8_t *src_bytes = (uint8_t *)src_bits;
+    int uncached_source = (src_bytes >= ctx->uncached_area_begin) &&
+                          (src_bytes < ctx->uncached_area_end);
+    if (!uncached_source && src_bits != dst_bits &&
+        pixman_blt_bpp_ok(src_bpp)) {
+        RPI_STATS_FALLBACK(ctx->stats, RPI_STATS_REASON_CACHED_SOURCE,
+                           src_bpp, width, height);
+        return CPU_BLT_DECLINE;
+    }
+
+    if (src_bpp != dst_bpp || src_bpp & 7) {
+        RPI_STATS_FALLBACK(ctx->stats, RPI_STATS_REASON_BPP_MISMATCH,
+                           src_bpp, width, height);
+        return CPU_BLT_DECLINE;
+    }
+    if (src_stride < 0 || dst_stride < 0) {
+        RPI_STATS_FALLBACK(ctx->stats, RPI_STATS_REASON_NEGATIVE_STRIDE,
+                           src_bpp, width, height);
+        return CPU_BLT_DECLINE;
+    }
+    return uncached_source ? CPU_BLT_TWOPASS : CPU_BLT_CACHED;
+}
+
+/*
+ * Heuristic for falling back to more compact CPU blit; this tries to
+ * catch the fact that for rightwards overlapped blits, overlapped_blt_arm
+ * is almost always faster, even for small sizes. It is checked after
+ * the hard requirements above, so that the adaptive thresholds only
+ * time the requests which could really be taken.
+ */
+static int
+overlapped_blt_accept_arm(cpu_backend_t *ctx,
+                          uint32_t      *src_bits,
+                          uint32_t      *dst_bits,
+                          int            bpp,
+                          int            src_x,
+                          int            src_y,
+                          int            dst_x,
+                          int            dst_y,
+                          int            width,
+                          int            height)
+{
+    int accept = !(((bpp == 8 && width < ARM_BLT_WIDTH_THRESHOLD_8BPP) ||
+                    (bpp == 16 && width < ARM_BLT_WIDTH_THRESHOLD_16BPP) ||
+                    (bpp == 24 && width < ARM_BLT_WIDTH_THRESHOLD_24BPP) ||
+                    (bpp == 32 && width < ARM_BLT_WIDTH_THRESHOLD_32BPP))
+                   && !(src_y == dst_y && src_x < dst_x &&
+                        src_x + width >= dst_x));
+    if (!RPI_ADAPT_DECIDE(ctx->adapt, RPI_ADAPT_CPU_BLT, bpp,
+                          rpi_adapt_direction(src_bits, dst_bits, src_x,
+                                              src_y, dst_x, dst_y),
+                          rpi_adapt_width_class(width), accept)) {
+        RPI_STATS_FALLBACK(ctx->stats, RPI_STATS_REASON_WIDTH_THRESHOLD,
+                           bpp, width, height);
+        return 0;
+    }
+    return 1;
+}
+
 static int
 overlapped_blt_arm(void     *self,
                     uint32_t *src_bits,
@@ -173,28 +611,37 @@ overlapped_blt_arm(void     *self,
                     int       width,
                     int       height)
 {
-    /*
-     * Heuristic for falling back to more compact CPU blit; this tries to
-     * catch the fact that for rightwards overlapped blits, overlapped_blt_arm
-     * is almost always faster, even for small sizes.
-     */
-    if (((src_bpp == 16 && width < ARM_BLT_WIDTH_THRESHOLD_16BPP) ||
-    (src_bpp == 32 && width < ARM_BLT_WIDTH_THRESHOLD_32BPP))
-    && !(src_y == dst_y && src_x < dst_x && src_x + width >= dst_x))
-        return 0;
+    cpu_backend_t *ctx = (cpu_backend_t *)self;
     uint8_t *dst_bytes = (uint8_t *)dst_bits;
     uint8_t *src_bytes = (uint8_t *)src_bits;
-    cpu_backend_t *ctx = (cpu_backend_t *)self;
     int bpp = src_bpp >> 3;
-    int uncached_source = (src_bytes >= ctx->uncached_area_begin) &&
-                          (src_bytes < ctx->uncached_area_end);
-    if (!uncached_source)
+    int mode = overlapped_blt_check_arm(ctx, src_bits, dst_bits, src_stride,
+                                        dst_stride, src_bpp, dst_bpp,
+                                        width, height);
+
+    if (mode == CPU_BLT_DECLINE)
         return 0;
 
-    if (src_bpp != dst_bpp || src_bpp & 7 || src_stride < 0 || dst_stride < 0)
+    if (mode == CPU_BLT_CACHED) {
+        cached_blt_8bpp_arm(ctx,
+                            (uintptr_t) width * bpp,
+                            height,
+                            dst_bytes + (uintptr_t) dst_y * dst_stride * 4 +
+                                        (uintptr_t) dst_x * bpp,
+                            (uintptr_t) dst_stride * 4,
+                            src_bytes + (uintptr_t) src_y * src_stride * 4 +
+                                        (uintptr_t) src_x * bpp,
+                            (uintptr_t) src_stride * 4);
+        return 1;
+    }
+
+    if (!overlapped_blt_accept_arm(ctx, src_bits, dst_bits, src_bpp,
+                                   src_x, src_y, dst_x, dst_y,
+                                   width, height))
         return 0;
 
-    twopass_blt_8bpp_arm((uintptr_t) width * bpp,
+    twopass_blt_8bpp_arm(ctx,
+                          (uintptr_t) width * bpp,
                           height,
                           dst_bytes + (uintptr_t) dst_y * dst_stride * 4 +
                                       (uintptr_t) dst_x * bpp,
@@ -205,6 +652,135 @@ overlapped_blt_arm(void     *self,
     return 1;
 }
 
+/*
+ * The box list variant of overlapped_blt_arm. The boxes can't be sorted
+ * or merged, their order matters for the overlapped copies.
+ */
+static int
+overlapped_blt_boxes_arm(void              *self,
+                         uint32_t          *src_bits,
+                         uint32_t          *dst_bits,
+                         int                src_stride,
+                         int                dst_stride,
+                         int                src_bpp,
+                         int                dst_bpp,
+                         const blt2d_box_t *boxes,
+                         int                nbox,
+                         int                src_dx,
+                         int                src_dy,
+                         int                dst_dx,
+                         int                dst_dy)
+{
+    cpu_backend_t *ctx = (cpu_backend_t *)self;
+    uint8_t *dst_bytes = (uint8_t *)dst_bits;
+    uint8_t *src_bytes = (uint8_t *)src_bits;
+    uintptr_t src_stride_bytes = (uintptr_t) src_stride * 4;
+    uintptr_t dst_stride_bytes = (uintptr_t) dst_stride * 4;
+    int bpp = src_bpp >> 3;
+    int mode, i;
+
+    if (nbox <= 0)
+        return 0;
+    mode = overlapped_blt_check_arm(ctx, src_bits, dst_bits, src_stride,
+                                    dst_stride, src_bpp, dst_bpp,
+                                    boxes[0].x2 - boxes[0].x1,
+                                    boxes[0].y2 - boxes[0].y1);
+    if (mode == CPU_BLT_DECLINE)
+        return 0;
+
+    for (i = 0; i < nbox; i++) {
+        int src_x = boxes[i].x1 + src_dx;
+        int src_y = boxes[i].y1 + src_dy;
+        int dst_x = boxes[i].x1 + dst_dx;
+        int dst_y = boxes[i].y1 + dst_dy;
+        int width = boxes[i].x2 - boxes[i].x1;
+        int height = boxes[i].y2 - boxes[i].y1;
+
+        if (mode == CPU_BLT_CACHED) {
+            cached_blt_8bpp_arm(ctx,
+                                (uintptr_t) width * bpp,
+                                height,
+                                dst_bytes + (uintptr_t) dst_y * dst_stride_bytes +
+                                            (uintptr_t) dst_x * bpp,
+                                dst_stride_bytes,
+                                src_bytes + (uintptr_t) src_y * src_stride_bytes +
+                                            (uintptr_t) src_x * bpp,
+                                src_stride_bytes);
+            continue;
+        }
+
+        if (!overlapped_blt_accept_arm(ctx, src_bits, dst_bits, src_bpp,
+                                       src_x, src_y, dst_x, dst_y,
+                                       width, height))
+            break;
+
+        twopass_blt_8bpp_arm(ctx,
+                              (uintptr_t) width * bpp,
+                              height,
+                              dst_bytes + (uintptr_t) dst_y * dst_stride_bytes +
+                                          (uintptr_t) dst_x * bpp,
+                              dst_stride_bytes,
+                              src_bytes + (uintptr_t) src_y * src_stride_bytes +
+                                          (uintptr_t) src_x * bpp,
+                              src_stride_bytes);
+    }
+    return i;
+}
+
+/*
+ * Dispatch hint for overlapped_blt_arm, which must agree with its checks.
+ * The rightwards overlapped exception of the width threshold only applies
+ * to copies within a row, which fbBlt does with the reverse flag set.
+ */
+static int
+overlapped_blt_route_arm(void     *self,
+                         uint32_t *src_bits,
+                         uint32_t *dst_bits,
+                         int       src_stride,
+                         int       dst_stride,
+                         int       src_bpp,
+                         int       dst_bpp,
+                         int       reverse,
+                         int       upsidedown,
+                         int       min_w,
+                         int       max_w)
+{
+    cpu_backend_t *ctx = (cpu_backend_t *)self;
+    uint8_t *src_bytes = (uint8_t *)src_bits;
+    int threshold = 0;
+
+    if (src_bpp != dst_bpp || src_bpp & 7 ||
+        src_stride < 0 || dst_stride < 0)
+        return BLT2D_ROUTE_NEVER;
+
+    /*
+     * Within one buffer in cached memory (or at the depths pixman doesn't
+     * copy), any width is taken
+     */
+    if (src_bytes < ctx->uncached_area_begin ||
+        src_bytes >= ctx->uncached_area_end)
+        return src_bits == dst_bits || !pixman_blt_bpp_ok(src_bpp) ?
+               BLT2D_ROUTE_ALWAYS : BLT2D_ROUTE_NEVER;
+
+    /* The adaptive thresholds may change their mind at any time */
+    if (ctx->adapt)
+        return BLT2D_ROUTE_MAYBE;
+
+    if (src_bpp == 8)
+        threshold = ARM_BLT_WIDTH_THRESHOLD_8BPP;
+    else if (src_bpp == 16)
+        threshold = ARM_BLT_WIDTH_THRESHOLD_16BPP;
+    else if (src_bpp == 24)
+        threshold = ARM_BLT_WIDTH_THRESHOLD_24BPP;
+    else if (src_bpp == 32)
+        threshold = ARM_BLT_WIDTH_THRESHOLD_32BPP;
+    if (min_w >= threshold)
+        return BLT2D_ROUTE_ALWAYS;
+    if (max_w <= threshold && !reverse)
+        return BLT2D_ROUTE_NEVER;
+    return BLT2D_ROUTE_MAYBE;
+}
+
 #endif
 
 /* An empty, always failing implementation */
@@ -226,6 +802,22 @@ overlapped_blt_noop(void     *self,
     return 0;
 }
 
+static int
+overlapped_blt_route_noop(void     *self,
+                          uint32_t *src_bits,
+                          uint32_t *dst_bits,
+                          int       src_stride,
+                          int       dst_stride,
+                          int       src_bpp,
+                          int       dst_bpp,
+                          int       reverse,
+                          int       upsidedown,
+                          int       min_w,
+                          int       max_w)
+{
+    return BLT2D_ROUTE_NEVER;
+}
+
 #ifdef __arm__
 
 /*
@@ -249,6 +841,7 @@ static int standard_blt_arm(void     *self,
                           int       w,
                           int       h)
 {
+    cpu_backend_t *ctx = (cpu_backend_t *)self;
     uint32_t src_stride_bytes = src_stride * 4;
     uint32_t dst_stride_bytes = dst_stride * 4;
     uint8_t *src = (uint8_t *)src_bits + src_y * src_stride_bytes + src_x * (src_bpp / 8);
@@ -258,6 +851,9 @@ static int standard_blt_arm(void     *self,
     int bw = w * (src_bpp / 8);
     uint8_t *srclinep = src;
     uint8_t *dstlinep = dst;
+    int source = (src >= ctx->uncached_area_begin &&
+                  src < ctx->uncached_area_end) ?
+                 CPU_MEMCPY_SRC_UNCACHED : CPU_MEMCPY_SRC_CACHED;
     if (bw >= src_stride_bytes - 64) {
         /*
          * If the source image scanlines are virtually contiguous to each other,
@@ -267,13 +863,13 @@ static int standard_blt_arm(void     *self,
         if (src_stride_bytes <= 128)
             h_preload = 128 / src_stride_bytes;
         while (h > h_preload) {
-            ARM_MEMCPY(dstlinep, srclinep, bw);
+            ARM_MEMCPY(ctx, source, dstlinep, srclinep, bw);
             srclinep += src_stride_bytes;
             dstlinep += dst_stride_bytes;
             h--;
         }
         while (h > 0) {
-            ARM_MEMCPY_NO_OVERFETCH(dstlinep, srclinep, bw);
+            ARM_MEMCPY_NO_OVERFETCH(ctx, source, dstlinep, srclinep, bw);
             srclinep += src_stride_bytes;
             dstlinep += dst_stride_bytes;
             h--;
@@ -281,19 +877,32 @@ static int standard_blt_arm(void     *self,
         return 1;
     }
     while (h > 1) {
-        ARM_MEMCPY_NO_OVERFETCH(dstlinep, srclinep, bw);
+        ARM_MEMCPY_NO_OVERFETCH(ctx, source, dstlinep, srclinep, bw);
         srclinep += src_stride_bytes;
         src_align32 = (uintptr_t)srclinep & (~(uint32_t)31);
         ARM_PRELOAD(src_align32, 0);
         dstlinep += dst_stride_bytes;
         h--;
     }
-    ARM_MEMCPY_NO_OVERFETCH(dstlinep, srclinep, bw);
+    ARM_MEMCPY_NO_OVERFETCH(ctx, source, dstlinep, srclinep, bw);
     return 1;
 }
 
 #endif
 
+/* The defaults, until the memcpy tuner picks better variants */
+static void
+set_default_memcpy(cpu_backend_t *ctx)
+{
+    int i, j;
+    for (i = 0; i < CPU_MEMCPY_NUM_SOURCES; i++) {
+        for (j = 0; j < CPU_MEMCPY_NUM_SIZE_CLASSES; j++) {
+            ctx->memcpy_no_overfetch[i][j] = DEFAULT_MEMCPY_NO_OVERFETCH;
+            ctx->memcpy_overfetch[i][j] = DEFAULT_MEMCPY_OVERFETCH;
+        }
+    }
+}
+
 static int
 fill_noop(void                *self,
           uint32_t            *bits,
@@ -309,6 +918,344 @@ fill_noop(void                *self,
 }
 
 
+/*
+ * 24bpp pixels are written one byte at a time up to a word boundary, then
+ * four pixels at a time as three words of the repeating pattern.
+ */
+static void
+fill_box_24bpp_cpu(uint8_t *line, uintptr_t stride_bytes, int width,
+                   int height, uint32_t color)
+{
+    uint8_t pattern[12];
+    uint32_t w0, w1, w2;
+    int i;
+
+    for (i = 0; i < 12; i += 3) {
+        pattern[i] = color;
+        pattern[i + 1] = color >> 8;
+        pattern[i + 2] = color >> 16;
+    }
+    memcpy(&w0, pattern, 4);
+    memcpy(&w1, pattern + 4, 4);
+    memcpy(&w2, pattern + 8, 4);
+
+    while (height-- > 0) {
+        uint8_t *p = line;
+        int n = width;
+
+        /* a pixel starts at a word boundary after at most 3 pixels */
+        while (((uintptr_t)p & 3) && n > 0) {
+            p[0] = pattern[0];
+            p[1] = pattern[1];
+            p[2] = pattern[2];
+            p += 3;
+            n--;
+        }
+        while (n >= 4) {
+            ((uint32_t *)p)[0] = w0;
+            ((uint32_t *)p)[1] = w1;
+            ((uint32_t *)p)[2] = w2;
+            p += 12;
+            n -= 4;
+        }
+        while (n-- > 0) {
+            p[0] = pattern[0];
+            p[1] = pattern[1];
+            p[2] = pattern[2];
+            p += 3;
+        }
+        line += stride_bytes;
+    }
+}
+
+/*
+ * 8bpp rows are written a byte at a time up to a word boundary, a word at
+ * a time up to a 32 byte boundary, and then in whole 32 byte bursts.
+ */
+static void
+fill_box_8bpp_cpu(uint8_t *line, uintptr_t stride_bytes, int width,
+                  int height, uint32_t color)
+{
+    uint32_t color32 = (color & 0xFF) * 0x01010101;
+
+    while (height-- > 0) {
+        uint8_t *p = line;
+        int n = width;
+        while (((uintptr_t)p & 3) && n > 0) {
+            *p++ = color32;
+            n--;
+        }
+        while (((uintptr_t)p & 31) && n >= 4) {
+            *(uint32_t *)p = color32;
+            p += 4;
+            n -= 4;
+        }
+        while (n >= 32) {
+            uint32_t *q = (uint32_t *)p;
+            q[0] = q[1] = q[2] = q[3] = color32;
+            q[4] = q[5] = q[6] = q[7] = color32;
+            p += 32;
+            n -= 32;
+        }
+        while (n >= 4) {
+            *(uint32_t *)p = color32;
+            p += 4;
+            n -= 4;
+        }
+        while (n-- > 0)
+            *p++ = color32;
+        line += stride_bytes;
+    }
+}
+
+static void
+fill_box_cpu(uint8_t *bits, uintptr_t stride_bytes, int bpp,
+             int x, int y, int width, int height, uint32_t color)
+{
+    uint8_t *line = bits + (uintptr_t) y * stride_bytes +
+                    (uintptr_t) x * (bpp >> 3);
+    uint32_t color32 = bpp == 16 ? (color & 0xFFFF) | (color << 16) : color;
+
+    if (bpp == 8) {
+        fill_box_8bpp_cpu(line, stride_bytes, width, height, color);
+        return;
+    }
+    if (bpp == 24) {
+        fill_box_24bpp_cpu(line, stride_bytes, width, height, color);
+        return;
+    }
+
+    while (height-- > 0) {
+        uint8_t *p = line;
+        int n = width;
+        if (bpp == 16) {
+            if (((uintptr_t)p & 2) && n > 0) {
+                *(uint16_t *)p = color32;
+                p += 2;
+                n--;
+            }
+            while (n >= 2) {
+                *(uint32_t *)p = color32;
+                p += 4;
+                n -= 2;
+            }
+            if (n)
+                *(uint16_t *)p = color32;
+        } else {
+            while (n-- > 0) {
+                *(uint32_t *)p = color32;
+                p += 4;
+            }
+        }
+        line += stride_bytes;
+    }
+}
+
+/*
+ * Fills the small boxes of a list. The leading boxes which are narrow
+ * enough are sorted by address and the horizontally adjacent ones are
+ * merged, the order of the fills doesn't matter as they all use the same
+ * color.
+ */
+static int
+fill_boxes_cpu(void              *self,
+               uint32_t          *bits,
+               int                stride,
+               int                bpp,
+               const blt2d_box_t *boxes,
+               int                nbox,
+               int                dx,
+               int                dy,
+               uint32_t           color)
+{
+    blt2d_box_t sorted[CPU_FILL_BATCH_SIZE];
+    int max_width = bpp == 24 ? INT_MAX : CPU_FILL_MAX_ROW_BYTES / (bpp >> 3);
+    int n, i, j, merged;
+
+    if ((bpp != 8 && bpp != 16 && bpp != 24 && bpp != 32) || stride < 0)
+        return 0;
+
+    for (n = 0; n < nbox && n < CPU_FILL_BATCH_SIZE; n++) {
+        blt2d_box_t box = boxes[n];
+        if (box.x2 - box.x1 > max_width)
+            break;
+        /* insertion sort by y1, then x1 */
+        for (j = n; j > 0 && (sorted[j - 1].y1 > box.y1 ||
+                              (sorted[j - 1].y1 == box.y1 &&
+                               sorted[j - 1].x1 > box.x1)); j--)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = box;
+    }
+    if (n == 0)
+        return 0;
+
+    for (i = 0, merged = 0; i < n; i++) {
+        if (merged > 0 && sorted[merged - 1].y1 == sorted[i].y1 &&
+            sorted[merged - 1].y2 == sorted[i].y2 &&
+            sorted[merged - 1].x2 == sorted[i].x1)
+            sorted[merged - 1].x2 = sorted[i].x2;
+        else
+            sorted[merged++] = sorted[i];
+    }
+
+    for (i = 0; i < merged; i++)
+        fill_box_cpu((uint8_t *)bits, (uintptr_t) stride * 4, bpp,
+                     sorted[i].x1 + dx, sorted[i].y1 + dy,
+                     sorted[i].x2 - sorted[i].x1,
+                     sorted[i].y2 - sorted[i].y1, color);
+    return n;
+}
+
+/*
+ * Words are written one at a time up to a 32 byte boundary and then in
+ * whole 32 byte bursts, like the 8bpp rows above.
+ */
+static inline void
+fill_words_cpu(uint32_t *q, int n, uint32_t color32)
+{
+    while (((uintptr_t)q & 31) && n > 0) {
+        *q++ = color32;
+        n--;
+    }
+    while (n >= 8) {
+        q[0] = q[1] = q[2] = q[3] = color32;
+        q[4] = q[5] = q[6] = q[7] = color32;
+        q += 8;
+        n -= 8;
+    }
+    while (n-- > 0)
+        *q++ = color32;
+}
+
+/*
+ * Fills a list of spans. Like for the boxes, the spans are sorted by
+ * address and the adjacent or overlapping ones of a row are merged, which
+ * turns the spans of mi, that come in any order, into row ordered writes.
+ * The 16 and 32bpp spans, which make up most of the filled arcs and
+ * polygons, have their own loops, the others are boxes of height 1.
+ */
+static int
+fill_spans_cpu(void               *self,
+               uint32_t           *bits,
+               int                 stride,
+               int                 bpp,
+               const blt2d_span_t *spans,
+               int                 nspan,
+               int                 dx,
+               int                 dy,
+               uint32_t            color)
+{
+    blt2d_span_t sorted[CPU_FILL_BATCH_SIZE];
+    int n, i, j, merged;
+
+    if ((bpp != 8 && bpp != 16 && bpp != 24 && bpp != 32) || stride < 0)
+        return 0;
+
+    for (n = 0; n < nspan && n < CPU_FILL_BATCH_SIZE; n++) {
+        blt2d_span_t span = spans[n];
+        /* insertion sort by y, then x */
+        for (j = n; j > 0 && (sorted[j - 1].y > span.y ||
+                              (sorted[j - 1].y == span.y &&
+                               sorted[j - 1].x > span.x)); j--)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = span;
+    }
+    if (n == 0)
+        return 0;
+
+    for (i = 1, merged = 1; i < n; i++) {
+        blt2d_span_t *last = &sorted[merged - 1];
+        if (last->y == sorted[i].y && last->x + last->width >= sorted[i].x) {
+            if (sorted[i].x + sorted[i].width > last->x + last->width)
+                last->width = sorted[i].x + sorted[i].width - last->x;
+        } else
+            sorted[merged++] = sorted[i];
+    }
+
+    if (bpp == 32) {
+        for (i = 0; i < merged; i++)
+            fill_words_cpu(bits + (sorted[i].y + dy) * stride +
+                           sorted[i].x + dx, sorted[i].width, color);
+    } else if (bpp == 16) {
+        uint32_t color32 = (color & 0xFFFF) | (color << 16);
+        for (i = 0; i < merged; i++) {
+            uint16_t *p = (uint16_t *)(bits + (sorted[i].y + dy) * stride) +
+                          sorted[i].x + dx;
+            int w = sorted[i].width;
+            if (((uintptr_t)p & 2) && w > 0) {
+                *p++ = color32;
+                w--;
+            }
+            fill_words_cpu((uint32_t *)p, w >> 1, color32);
+            if (w & 1)
+                p[w - 1] = color32;
+        }
+    } else {
+        for (i = 0; i < merged; i++)
+            fill_box_cpu((uint8_t *)bits, (uintptr_t) stride * 4, bpp,
+                         sorted[i].x + dx, sorted[i].y + dy, sorted[i].width,
+                         1, color);
+    }
+    return n;
+}
+
+/*
+ * The copies from the framebuffer to ordinary memory. Unlike for the
+ * copies within the framebuffer, the two-pass memmove pays off whatever
+ * the width: a few 32 byte aligned bursts into the scratch buffer are
+ * still much cheaper than the single word reads of the uncached source
+ * by small_blt or pixman.
+ */
+static int
+readback_blt_arm(void     *self,
+                 uint32_t *src_bits,
+                 uint32_t *dst_bits,
+                 int       src_stride,
+                 int       dst_stride,
+                 int       bpp,
+                 int       src_x,
+                 int       src_y,
+                 int       dst_x,
+                 int       dst_y,
+                 int       width,
+                 int       height)
+{
+    cpu_backend_t *ctx = (cpu_backend_t *)self;
+    uint8_t *src_bytes = (uint8_t *)src_bits;
+    uint8_t *dst_bytes = (uint8_t *)dst_bits;
+
+    if (src_bytes < ctx->uncached_area_begin ||
+        src_bytes >= ctx->uncached_area_end) {
+        RPI_STATS_FALLBACK(ctx->stats, RPI_STATS_REASON_CACHED_SOURCE,
+                           bpp, width, height);
+        return 0;
+    }
+    if (dst_bytes >= ctx->uncached_area_begin &&
+        dst_bytes < ctx->uncached_area_end)
+        return 0;
+    if (bpp == 0 || bpp & 7) {
+        RPI_STATS_FALLBACK(ctx->stats, RPI_STATS_REASON_BPP_MISMATCH,
+                           bpp, width, height);
+        return 0;
+    }
+    if (src_stride < 0 || dst_stride < 0) {
+        RPI_STATS_FALLBACK(ctx->stats, RPI_STATS_REASON_NEGATIVE_STRIDE,
+                           bpp, width, height);
+        return 0;
+    }
+
+    twopass_blt_8bpp_arm(ctx,
+                         (uintptr_t) width * (bpp >> 3),
+                         height,
+                         dst_bytes + (uintptr_t) dst_y * dst_stride * 4 +
+                                     (uintptr_t) dst_x * (bpp >> 3),
+                         (uintptr_t) dst_stride * 4,
+                         src_bytes + (uintptr_t) src_y * src_stride * 4 +
+                                     (uintptr_t) src_x * (bpp >> 3),
+                         (uintptr_t) src_stride * 4);
+    return 1;
+}
+
 cpu_backend_t *cpu_backend_init(uint8_t *uncached_buffer,
                                 size_t   uncached_buffer_size)
 {
@@ -321,11 +1268,16 @@ cpu_backend_t *cpu_backend_init(uint8_t *uncached_buffer,
 
     ctx->blt2d.self = ctx;
     ctx->blt2d.overlapped_blt = overlapped_blt_noop;
+    ctx->blt2d.overlapped_blt_route = overlapped_blt_route_noop;
     /*
      * Initialize the fill function with NULL to indicate that it is not
      * available.
      */
     ctx->blt2d.fill = NULL;
+    ctx->blt2d.fill_boxes = fill_boxes_cpu;
+    ctx->blt2d.fill_spans = fill_spans_cpu;
+    ctx->blt2d.readback_blt = readback_blt_arm;
+    ctx->blt2d.rop_blt = rop_blt_cpu;
 
     ctx->cpuinfo = cpuinfo_init();
 
@@ -336,8 +1288,11 @@ cpu_backend_t *cpu_backend_init(uint8_t *uncached_buffer,
     }
 #endif
     ctx->blt2d.overlapped_blt = overlapped_blt_arm;
+    ctx->blt2d.overlapped_blt_route = overlapped_blt_route_arm;
+    ctx->blt2d.overlapped_blt_boxes = overlapped_blt_boxes_arm;
     ctx->blt2d.standard_blt = standard_blt_arm;
 #endif
+    set_default_memcpy(ctx);
 
     return ctx;
 }
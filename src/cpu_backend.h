@@ -28,6 +28,37 @@
 
 #include "cpuinfo.h"
 #include "interfaces.h"
+#include "rpi_stats.h"
+#include "rpi_adapt.h"
+
+/*
+ * The memcpy functions used by the blit functions are picked from a
+ * dispatch table, indexed by the kind of memory of the source and by the
+ * size class of the copy. The table is filled with the default arm_asm.S
+ * variants and may be replaced by the memcpy tuner (see memcpy_tune.h).
+ */
+typedef void *(*cpu_memcpy_t)(void *dst, const void *src, int size);
+
+enum {
+    CPU_MEMCPY_SRC_CACHED,   /* ordinary RAM (pixmaps, the scratch buffer) */
+    CPU_MEMCPY_SRC_UNCACHED, /* the framebuffer */
+    CPU_MEMCPY_NUM_SOURCES
+};
+
+/* Size classes: < 128, < 512, < 2048 and >= 2048 bytes */
+#define CPU_MEMCPY_NUM_SIZE_CLASSES 4
+
+static inline int
+cpu_memcpy_size_class(int size)
+{
+    if (size < 128)
+        return 0;
+    if (size < 512)
+        return 1;
+    if (size < 2048)
+        return 2;
+    return 3;
+}
 
 /*
  * A set of CPU specific optimizations for different operations.
@@ -42,9 +73,53 @@ typedef struct {
     uint8_t   *uncached_area_end;
     /* An accelerated implementation of blt2d_i interface */
     blt2d_i    blt2d;
+    /* Where to record the reasons for declined requests (may be NULL) */
+    rpi_stats_t *stats;
+    /* The adaptive width thresholds (NULL to use the fixed ones) */
+    rpi_adapt_t *adapt;
+    /*
+     * The memcpy dispatch tables. The overfetch functions may read up to
+     * a cache line beyond the end of the source, the no_overfetch ones
+     * never do.
+     */
+    cpu_memcpy_t memcpy_no_overfetch[CPU_MEMCPY_NUM_SOURCES]
+                                    [CPU_MEMCPY_NUM_SIZE_CLASSES];
+    cpu_memcpy_t memcpy_overfetch[CPU_MEMCPY_NUM_SOURCES]
+                                 [CPU_MEMCPY_NUM_SIZE_CLASSES];
 } cpu_backend_t;
 
 cpu_backend_t *cpu_backend_init(uint8_t *uncached_buffer, size_t uncached_buffer_size);
 void cpu_backend_close(cpu_backend_t *cpu_backend);
 
+/*
+ * The size of the on-stack scratch buffer of the two-pass memmove. It can
+ * be overridden at build time, to tune it with bench/rpifb-twopass.
+ */
+#ifndef SCRATCHSIZE
+#define SCRATCHSIZE 2048
+#endif
+
+/*
+ * The two-pass memmove used by overlapped_blt, which reads the source in
+ * 32 byte aligned chunks into a scratch buffer (so it may read up to 31
+ * bytes before and after the source) and then writes them out. Exported
+ * for bench/rpifb-twopass, on other architectures than ARM portable C
+ * stand-ins replace the assembler functions.
+ */
+void twopass_memmove_arm(cpu_backend_t *ctx, void *dst, const void *src,
+                         size_t size);
+void twopass_blt_8bpp_arm(cpu_backend_t *ctx, int width, int height,
+                          uint8_t *dst_bytes, uintptr_t dst_stride,
+                          uint8_t *src_bytes, uintptr_t src_stride);
+
+/*
+ * The same for a source in cached memory, which is copied directly, or
+ * in chunks when the source and the destination overlap.
+ */
+void cached_memmove_arm(cpu_backend_t *ctx, void *dst, const void *src,
+                        size_t size);
+void cached_blt_8bpp_arm(cpu_backend_t *ctx, int width, int height,
+                         uint8_t *dst_bytes, uintptr_t dst_stride,
+                         uint8_t *src_bytes, uintptr_t src_stride);
+
 #endif
@@ -47,6 +47,7 @@
 #include "dgaproc.h"
 
 #include "cpu_backend.h"
+#include "memcpy_tune.h"
 
 #include "rpi_disp.h"
 //#include "rpi_disp_hwcursor.h"
@@ -162,6 +163,13 @@ typedef enum {
 	OPTION_DRI2,
 	OPTION_DRI2_OVERLAY,
 	OPTION_ACCELMETHOD,
+	OPTION_STATISTICS,
+	OPTION_TRACE_FILE,
+	OPTION_TRACE_IMAGE_HASH,
+	OPTION_MEMCPY_TUNE,
+	OPTION_MEMCPY_TUNE_CACHE,
+	OPTION_LATENCY_SAMPLING,
+	OPTION_ADAPTIVE_THRESHOLDS,
 } FBDevOpts;
 
 static const OptionInfoRec FBDevOptions[] = {
@@ -174,6 +182,13 @@ static const OptionInfoRec FBDevOptions[] = {
 	{ OPTION_DRI2,		"DRI2",		OPTV_BOOLEAN,	{0},	FALSE },
 	{ OPTION_DRI2_OVERLAY,	"DRI2HWOverlay",OPTV_BOOLEAN,	{0},	FALSE },
 	{ OPTION_ACCELMETHOD,	"AccelMethod",	OPTV_STRING,	{0},	FALSE },
+	{ OPTION_STATISTICS,	"Statistics",	OPTV_BOOLEAN,	{0},	FALSE },
+	{ OPTION_TRACE_FILE,	"TraceFile",	OPTV_STRING,	{0},	FALSE },
+	{ OPTION_TRACE_IMAGE_HASH, "TraceImageHash", OPTV_BOOLEAN, {0},	FALSE },
+	{ OPTION_MEMCPY_TUNE,	"MemcpyTune",	OPTV_BOOLEAN,	{0},	FALSE },
+	{ OPTION_MEMCPY_TUNE_CACHE, "MemcpyTuneCache", OPTV_STRING, {0}, FALSE },
+	{ OPTION_LATENCY_SAMPLING, "LatencySampling", OPTV_INTEGER, {0}, FALSE },
+	{ OPTION_ADAPTIVE_THRESHOLDS, "AdaptiveThresholds", OPTV_BOOLEAN, {0}, FALSE },
 	{ -1,			NULL,		OPTV_NONE,	{0},	FALSE }
 };
 
@@ -685,6 +700,39 @@ FBDevShadowInit(ScreenPtr pScreen)
 }
 
 
+/* Pick the fastest memcpy variants for this Pi, see memcpy_tune.h */
+static void
+FBDevMemcpyTune(ScrnInfoPtr pScrn, cpu_backend_t *cpu_backend)
+{
+	FBDevPtr fPtr = FBDEVPTR(pScrn);
+	const char *cache_file;
+	int result, source, size_class;
+
+	if (!(cache_file = xf86GetOptValString(fPtr->Options,
+	                                       OPTION_MEMCPY_TUNE_CACHE)))
+		cache_file = MEMCPY_TUNE_CACHE_FILE;
+
+	result = memcpy_tune(cpu_backend, cache_file, pScrn->virtualX,
+	                     pScrn->virtualY, pScrn->bitsPerPixel);
+	if (result == MEMCPY_TUNE_FAILED) {
+		xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+		           "memcpy tuning is not supported, using the defaults\n");
+		return;
+	}
+
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO, "memcpy variants %s %s:\n",
+	           result == MEMCPY_TUNE_CACHED ? "loaded from" : "calibrated and saved to",
+	           cache_file);
+	for (source = 0; source < CPU_MEMCPY_NUM_SOURCES; source++)
+		for (size_class = 0; size_class < CPU_MEMCPY_NUM_SIZE_CLASSES;
+		     size_class++)
+			xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+			           "  %s source, size class %d: %s, %s\n",
+			           memcpy_tune_source_name(source), size_class,
+			           memcpy_tune_name(cpu_backend->memcpy_no_overfetch[source][size_class]),
+			           memcpy_tune_name(cpu_backend->memcpy_overfetch[source][size_class]));
+}
+
 static Bool
 FBDevScreenInit(SCREEN_INIT_ARGS_DECL)
 {
@@ -695,6 +743,8 @@ FBDevScreenInit(SCREEN_INIT_ARGS_DECL)
 	int ret, flags;
 	int type;
 	char *accelmethod;
+	char *tracefile;
+	int latency_sampling;
 	cpu_backend_t *cpu_backend;
 
 	TRACE_ENTER("FBDevScreenInit");
@@ -866,6 +916,10 @@ FBDevScreenInit(SCREEN_INIT_ARGS_DECL)
 	cpu_backend = cpu_backend_init(fPtr->fbmem, pScrn->videoRam);
 	fPtr->cpu_backend_private = cpu_backend;
 
+	if (cpu_backend &&
+	    xf86ReturnOptValBool(fPtr->Options, OPTION_MEMCPY_TUNE, FALSE))
+		FBDevMemcpyTune(pScrn, cpu_backend);
+
 #if 0
 	/* try to load G2D kernel module before initializing sunxi-disp */
 	if (!xf86LoadKernelModule("g2d_23"))
@@ -916,6 +970,40 @@ FBDevScreenInit(SCREEN_INIT_ARGS_DECL)
 		}
 	}
 
+	if (fPtr->RPIAccel_private &&
+	    xf86ReturnOptValBool(fPtr->Options, OPTION_STATISTICS, FALSE)) {
+		RPIAccel_EnableStatistics(pScreen);
+		/* let the backends record why they decline requests */
+		cpu_backend->stats = RPI_ACCEL(pScrn)->stats;
+		if (fPtr->rpi_disp_private)
+			RPI_DISP(pScrn)->stats = RPI_ACCEL(pScrn)->stats;
+	}
+
+	if (fPtr->RPIAccel_private &&
+	    (tracefile = xf86GetOptValString(fPtr->Options, OPTION_TRACE_FILE))) {
+		RPIAccel_EnableTrace(pScreen, tracefile,
+			xf86ReturnOptValBool(fPtr->Options, OPTION_TRACE_IMAGE_HASH,
+			                     FALSE));
+	}
+
+	if (fPtr->RPIAccel_private &&
+	    xf86ReturnOptValBool(fPtr->Options, OPTION_ADAPTIVE_THRESHOLDS,
+	                         FALSE)) {
+		RPIAccel_EnableAdaptiveThresholds(pScreen);
+		/*
+		 * the CPU backend consults it for its width decisions, the
+		 * accelerated paths of rpi_disp aren't implemented yet, so
+		 * their size thresholds have nothing to learn
+		 */
+		cpu_backend->adapt = RPI_ACCEL(pScrn)->adapt;
+	}
+
+	if (fPtr->RPIAccel_private &&
+	    xf86GetOptValInteger(fPtr->Options, OPTION_LATENCY_SAMPLING,
+	                         &latency_sampling) && latency_sampling > 0) {
+		RPIAccel_EnableLatency(pScreen, latency_sampling);
+	}
+
 	if (fPtr->shadowFB && !FBDevShadowInit(pScreen)) {
 	    xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
 		       "shadow framebuffer initialization failed\n");
@@ -0,0 +1,136 @@
+/*
+ * Copyright © 2013 The xf86-video-rpifb authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef FILL_ARC_H
+#define FILL_ARC_H
+
+/*
+ * The scan conversion of the full filled circles and ellipses of the
+ * PolyFillArc hook of rpi_x.c. This is the integer stepping of
+ * miFillEllipseI in mi/mifillarc.c, so the rows are exactly those which mi
+ * hands to FillSpans. The ellipse is stepped from its middle row outwards
+ * and each step gives the span of a row in the upper half and, by
+ * symmetry, the one of the matching row in the lower half.
+ */
+
+typedef struct {
+    int x, y, e;
+    int xk, xm, yk, ym;
+    int dx, dy;
+    int xorg, yorg;
+} fill_arc_t;
+
+/* Nothing is drawn (miFillArcEmpty for a full arc) */
+static inline int
+fill_arc_empty(int width, int height)
+{
+    return !width || !height || (width == 1 && (height & 1));
+}
+
+/*
+ * Whether the integer stepping is exact (miCanFillArc), mi uses floating
+ * point for the other ellipses.
+ */
+static inline int
+fill_arc_exact(int width, int height)
+{
+    return width == height || (width <= 800 && height <= 800);
+}
+
+/* The bounding box of the arc is x, y, width, height (miFillArcSetup) */
+static inline void
+fill_arc_init(fill_arc_t *arc, int x, int y, int width, int height)
+{
+    arc->x = 0;
+    arc->y = height >> 1;
+    arc->dy = height & 1;
+    arc->yorg = y + arc->y;
+    arc->dx = width & 1;
+    arc->xorg = x + (width >> 1) + arc->dx;
+    arc->dx = 1 - arc->dx;
+    if (width == height) {
+        arc->ym = 8;
+        arc->xm = 8;
+        arc->yk = arc->y << 3;
+        if (!arc->dx) {
+            arc->xk = 0;
+            arc->e = -1;
+        } else {
+            arc->y++;
+            arc->yk += 4;
+            arc->xk = -4;
+            arc->e = -(arc->y << 3);
+        }
+    } else {
+        arc->ym = (width * width) << 3;
+        arc->xm = (height * height) << 3;
+        arc->yk = arc->y * arc->ym;
+        if (!arc->dy)
+            arc->yk -= arc->ym >> 1;
+        if (!arc->dx) {
+            arc->xk = 0;
+            arc->e = -(arc->xm >> 3);
+        } else {
+            arc->y++;
+            arc->yk += arc->ym;
+            arc->xk = -(arc->xm >> 1);
+            arc->e = arc->xk - arc->yk;
+        }
+    }
+}
+
+/*
+ * Step to the next pair of rows (MIFILLARCSTEP). Returns 0 when the arc
+ * is done. Otherwise the span of *width pixels from *x is drawn in row
+ * *y_upper, and also in row *y_lower when 2 is returned. The width may be
+ * 0.
+ */
+static inline int
+fill_arc_step(fill_arc_t *arc, int *x, int *width, int *y_upper,
+              int *y_lower)
+{
+    int slw;
+
+    if (arc->y <= 0)
+        return 0;
+    arc->e += arc->yk;
+    while (arc->e >= 0) {
+        arc->x++;
+        arc->xk -= arc->xm;
+        arc->e += arc->xk;
+    }
+    arc->y--;
+    arc->yk -= arc->ym;
+    slw = (arc->x << 1) + arc->dx;
+    if (arc->e == arc->xk && slw > 1)
+        slw--;
+
+    *x = arc->xorg - arc->x;
+    *width = slw;
+    *y_upper = arc->yorg - arc->y;
+    *y_lower = arc->yorg + arc->y + arc->dy;
+    /* miFillArcLower */
+    return arc->y + arc->dy != 0 && (slw > 1 || arc->e != arc->xk) ? 2 : 1;
+}
+
+#endif
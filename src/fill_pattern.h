@@ -0,0 +1,254 @@
+/*
+ * Copyright © 2013 The xf86-video-rpifb authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef FILL_PATTERN_H
+#define FILL_PATTERN_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+/*
+ * The tiled and stippled fills of the PolyFillRect and FillSpans hooks of
+ * rpi_x.c. The pattern is prepared once per request: a tile with rows
+ * narrower than FILL_PATTERN_STRIP_BYTES is repeated into a strip of at
+ * least that width, so that a row of a fill takes a few memcpy of whole
+ * strips rather than one per tile width. A stipple is expanded to such a
+ * strip of pixels with a 1bpp-to-pixel table, which holds the pixels of
+ * each nibble of stipple bits. The transparent stipples also get a byte
+ * per pixel telling which ones are written.
+ */
+
+#define FILL_PATTERN_STRIP_BYTES 256
+
+/* The most memory an expanded pattern may use, larger tiles are used as is */
+#define FILL_PATTERN_MAX_BYTES (64 * 1024)
+
+typedef struct {
+    const uint8_t *bits;        /* the rows of pixels */
+    intptr_t       stride;      /* in bytes */
+    int            width;       /* the period along x, in pixels */
+    int            height;
+    int            bpp;
+    const uint8_t *mask;        /* a byte per pixel, NULL when opaque */
+    intptr_t       mask_stride;
+    uint32_t       fg;          /* the pixel of the masked pixels */
+    uint8_t       *alloc;       /* the expanded pattern, or NULL */
+} fill_pattern_t;
+
+/* The phase of d in a pattern of the given period */
+static inline int
+fill_pattern_phase(int d, int period)
+{
+    d %= period;
+    return d < 0 ? d + period : d;
+}
+
+/* The rows of the expanded patterns start at 32 byte boundaries */
+static inline uint8_t *
+fill_pattern_alloc(fill_pattern_t *pat, size_t size)
+{
+    pat->alloc = malloc(size + 31);
+    if (!pat->alloc)
+        return NULL;
+    return (uint8_t *)(((uintptr_t)pat->alloc + 31) & ~(uintptr_t)31);
+}
+
+/* How many copies of a row of width pixels fill a strip */
+static inline int
+fill_pattern_copies(int width, int bpp)
+{
+    int row_bytes = width * (bpp >> 3);
+    return (FILL_PATTERN_STRIP_BYTES + row_bytes - 1) / row_bytes;
+}
+
+/* The tile rows are stride bytes apart, the tile is used as is if need be */
+static inline void
+fill_pattern_init_tile(fill_pattern_t *pat, const uint8_t *tile,
+                       intptr_t stride, int width, int height, int bpp)
+{
+    int row_bytes = width * (bpp >> 3);
+    int copies = fill_pattern_copies(width, bpp);
+    intptr_t strip_stride = ((intptr_t) copies * row_bytes + 31) & ~31;
+    uint8_t *strip;
+    int y, i;
+
+    memset(pat, 0, sizeof(*pat));
+    pat->bits = tile;
+    pat->stride = stride;
+    pat->width = width;
+    pat->height = height;
+    pat->bpp = bpp;
+
+    if (copies == 1 || strip_stride * height > FILL_PATTERN_MAX_BYTES)
+        return;
+    strip = fill_pattern_alloc(pat, strip_stride * height);
+    if (!strip)
+        return;
+    for (y = 0; y < height; y++)
+        for (i = 0; i < copies; i++)
+            memcpy(strip + y * strip_stride + i * row_bytes,
+                   tile + y * stride, row_bytes);
+    pat->bits = strip;
+    pat->stride = strip_stride;
+    pat->width = copies * width;
+}
+
+static inline void
+fill_pattern_put_pixel(uint8_t *p, int bpp, uint32_t pixel)
+{
+    switch (bpp) {
+    case 8:
+        *p = pixel;
+        break;
+    case 16:
+        *(uint16_t *)p = pixel;
+        break;
+    case 24:
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        p[0] = pixel >> 16;
+        p[1] = pixel >> 8;
+        p[2] = pixel;
+#else
+        p[0] = pixel;
+        p[1] = pixel >> 8;
+        p[2] = pixel >> 16;
+#endif
+        break;
+    default:
+        *(uint32_t *)p = pixel;
+        break;
+    }
+}
+
+/* Bit x of a row of stipple words, in the bit order of the server */
+static inline int
+fill_pattern_bit(const uint32_t *row, int x, int lsb_first)
+{
+    uint32_t w = row[x >> 5];
+    return lsb_first ? (w >> (x & 31)) & 1 : (w >> (31 - (x & 31))) & 1;
+}
+
+/*
+ * The stipple rows are stride words apart. The set bits are drawn with
+ * fg, the others with bg if opaque is set and not at all otherwise.
+ * Returns 0 if the expanded stipple would be too large.
+ */
+static inline int
+fill_pattern_init_stipple(fill_pattern_t *pat, const uint32_t *stipple,
+                          intptr_t stride, int width, int height,
+                          int lsb_first, int bpp, uint32_t fg, uint32_t bg,
+                          int opaque)
+{
+    int Bpp = bpp >> 3;
+    int ewidth = fill_pattern_copies(width, bpp) * width;
+    intptr_t pixel_stride = ((intptr_t) ewidth * Bpp + 31) & ~31;
+    intptr_t mask_stride = opaque ? 0 : ((intptr_t) ewidth + 31) & ~31;
+    uint8_t table[16][4 * 4];
+    uint8_t *pixels, *mask;
+    int n, i, x, y;
+
+    memset(pat, 0, sizeof(*pat));
+    if ((pixel_stride + mask_stride) * height > FILL_PATTERN_MAX_BYTES)
+        return 0;
+    pixels = fill_pattern_alloc(pat, (pixel_stride + mask_stride) * height);
+    if (!pixels)
+        return 0;
+    mask = pixels + pixel_stride * height;
+
+    for (n = 0; n < 16; n++)
+        for (i = 0; i < 4; i++)
+            fill_pattern_put_pixel(&table[n][i * Bpp], bpp,
+                                   (n >> i) & 1 ? fg : bg);
+
+    for (y = 0; y < height; y++) {
+        const uint32_t *row = stipple + y * stride;
+        uint8_t *p = pixels + y * pixel_stride;
+        uint8_t *m = mask + y * mask_stride;
+        for (x = 0; x < ewidth; x += 4) {
+            int count = ewidth - x < 4 ? ewidth - x : 4;
+            int nibble = 0;
+            for (i = 0; i < count; i++) {
+                int bit = fill_pattern_bit(row, (x + i) % width, lsb_first);
+                nibble |= bit << i;
+                if (!opaque)
+                    m[x + i] = bit;
+            }
+            memcpy(p + x * Bpp, table[nibble], count * Bpp);
+        }
+    }
+
+    pat->bits = pixels;
+    pat->stride = pixel_stride;
+    pat->width = ewidth;
+    pat->height = height;
+    pat->bpp = bpp;
+    pat->mask = opaque ? NULL : mask;
+    pat->mask_stride = mask_stride;
+    pat->fg = fg;
+    return 1;
+}
+
+static inline void
+fill_pattern_fini(fill_pattern_t *pat)
+{
+    free(pat->alloc);
+    pat->alloc = NULL;
+}
+
+/*
+ * Write width pixels to dst from the pattern row ty, starting at the
+ * phase tx (see fill_pattern_phase).
+ */
+static inline void
+fill_pattern_row(const fill_pattern_t *pat, uint8_t *dst, int tx, int ty,
+                 int width)
+{
+    int Bpp = pat->bpp >> 3;
+    const uint8_t *row = pat->bits + ty * pat->stride;
+    const uint8_t *m;
+
+    if (!pat->mask) {
+        while (width > 0) {
+            int w = pat->width - tx;
+            if (w > width)
+                w = width;
+            memcpy(dst, row + tx * Bpp, w * Bpp);
+            dst += w * Bpp;
+            width -= w;
+            tx = 0;
+        }
+        return;
+    }
+
+    m = pat->mask + ty * pat->mask_stride;
+    while (width-- > 0) {
+        if (m[tx])
+            fill_pattern_put_pixel(dst, pat->bpp, pat->fg);
+        dst += Bpp;
+        if (++tx == pat->width)
+            tx = 0;
+    }
+}
+
+#endif
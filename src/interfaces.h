@@ -24,6 +24,21 @@
 #ifndef INTERFACES_H
 #define INTERFACES_H
 
+/*
+ * A rectangle of the box list functions, with exclusive x2 and y2. It has
+ * the same layout as the BoxRec of the X server.
+ */
+typedef struct {
+    int16_t x1, y1, x2, y2;
+} blt2d_box_t;
+
+/* A horizontal run of the span list functions, width pixels from x, y */
+typedef struct {
+    int16_t x, y;
+    int16_t width;
+    int16_t pad;
+} blt2d_span_t;
+
 /* A simple interface for 2D graphics operations */
 typedef struct {
     void *self; /* The pointer which needs to be passed to functions */
@@ -67,6 +82,115 @@ typedef struct {
                 int                 width,
                 int                 height,
                 uint32_t            color);
+    /*
+     * Optional (may be NULL): tells in advance whether overlapped_blt
+     * takes requests with these buffers and formats, the copy direction
+     * flags of fbBlt and widths in the range [min_w, max_w). Used by the
+     * X driver to build its dispatch table, so that it doesn't call an
+     * implementation for requests which it declines anyway. A request
+     * answered with BLT2D_ROUTE_NEVER is left to the next stage, which
+     * must not change the result.
+     */
+    int (*overlapped_blt_route)(void     *self,
+                                uint32_t *src_bits,
+                                uint32_t *dst_bits,
+                                int       src_stride,
+                                int       dst_stride,
+                                int       src_bpp,
+                                int       dst_bpp,
+                                int       reverse,
+                                int       upsidedown,
+                                int       min_w,
+                                int       max_w);
+    /*
+     * Optional (may be NULL): overlapped_blt for a list of boxes, so that
+     * the buffers and formats are checked once for the whole list. The
+     * destination of a box is the box translated by (dst_dx, dst_dy) and
+     * its source the box translated by (src_dx, src_dy). The boxes are
+     * done in order, up to the first one which overlapped_blt would have
+     * declined, and the number of boxes done is returned. Keeping the
+     * order lets the caller finish the remaining boxes some other way
+     * when the boxes of an overlapped copy depend on each other.
+     */
+    int (*overlapped_blt_boxes)(void              *self,
+                                uint32_t          *src_bits,
+                                uint32_t          *dst_bits,
+                                int                src_stride,
+                                int                dst_stride,
+                                int                src_bpp,
+                                int                dst_bpp,
+                                const blt2d_box_t *boxes,
+                                int                nbox,
+                                int                src_dx,
+                                int                src_dy,
+                                int                dst_dx,
+                                int                dst_dy);
+    /* Optional (may be NULL): fill for a list of boxes, the same way */
+    int (*fill_boxes)(void              *self,
+                      uint32_t          *bits,
+                      int                stride,
+                      int                bpp,
+                      const blt2d_box_t *boxes,
+                      int                nbox,
+                      int                dx,
+                      int                dy,
+                      uint32_t           color);
+    /*
+     * Optional (may be NULL): fill for a list of spans, like the rows of
+     * the filled arcs, translated by (dx, dy). Returns the number of spans
+     * done from the start of the list.
+     */
+    int (*fill_spans)(void               *self,
+                      uint32_t           *bits,
+                      int                 stride,
+                      int                 bpp,
+                      const blt2d_span_t *spans,
+                      int                 nspan,
+                      int                 dx,
+                      int                 dy,
+                      uint32_t            color);
+    /*
+     * Optional (may be NULL): a copy from the framebuffer to ordinary
+     * memory, like the screen grabs of GetImage, taken whatever its width.
+     * The source and the destination are different buffers.
+     */
+    int (*readback_blt)(void     *self,
+                        uint32_t *src_bits,
+                        uint32_t *dst_bits,
+                        int       src_stride,
+                        int       dst_stride,
+                        int       bpp,
+                        int       src_x,
+                        int       src_y,
+                        int       dst_x,
+                        int       dst_y,
+                        int       w,
+                        int       h);
+    /*
+     * Optional (may be NULL): overlapped_blt with one of the X raster
+     * operations (GXclear to GXset) and a planemask, which is replicated
+     * to 32 bits like the planemask of fb.
+     */
+    int (*rop_blt)(void     *self,
+                   uint32_t *src_bits,
+                   uint32_t *dst_bits,
+                   int       src_stride,
+                   int       dst_stride,
+                   int       src_bpp,
+                   int       dst_bpp,
+                   int       src_x,
+                   int       src_y,
+                   int       dst_x,
+                   int       dst_y,
+                   int       w,
+                   int       h,
+                   int       alu,
+                   uint32_t  planemask);
 } blt2d_i;
 
+/* The answers of overlapped_blt_route */
+#define BLT2D_ROUTE_NEVER  0 /* declines all such requests */
+#define BLT2D_ROUTE_MAYBE  1 /* depends on the request, call overlapped_blt */
+#define BLT2D_ROUTE_ALWAYS 2 /* takes all such requests */
+
 #endif
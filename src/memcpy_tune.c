@@ -0,0 +1,354 @@
+/*
+ * Copyright © 2013 The xf86-video-rpifb authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "cpu_backend.h"
+#include "memcpy_tune.h"
+#include "arm_asm.h"
+
+#define MEMCPY_TUNE_MAGIC "rpifb-memcpy-tune 1"
+
+/* The size of the copies used to time each size class */
+static const int memcpy_tune_sizes[CPU_MEMCPY_NUM_SIZE_CLASSES] = {
+    64, 256, 1024, 4096
+};
+
+/*
+ * The start offsets of the copies, cycled through so that every variant
+ * also sees unaligned and 16bpp aligned copies.
+ */
+static const int memcpy_tune_offsets[] = { 0, 2, 4, 8, 12, 20, 28 };
+
+#define MEMCPY_TUNE_NUM_OFFSETS \
+    (sizeof(memcpy_tune_offsets) / sizeof(memcpy_tune_offsets[0]))
+
+/* Room for the largest copy, its offset and the overfetch */
+#define MEMCPY_TUNE_AREA_SIZE (4096 + 32 + 64)
+
+/* Each variant is timed for at least this long, the best of 3 runs is used */
+#define MEMCPY_TUNE_MIN_TIME 0.001
+#define MEMCPY_TUNE_RUNS     3
+
+static const char *memcpy_tune_source_names[CPU_MEMCPY_NUM_SOURCES] = {
+    "cached", "uncached"
+};
+
+#ifdef __arm__
+
+#define MEMCPY_VARIANT(name, overfetch) \
+    { #name, (cpu_memcpy_t)name, overfetch }
+
+static const memcpy_variant_t memcpy_variants[] = {
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_overfetch, 1),
+#ifndef RPI_BEST_MEMCPY_ONLY
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_align_16_block_write_8_preload_96, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_align_16_block_write_16_preload_96, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_align_16_block_write_16_preload_early_96, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_align_16_block_write_16_preload_early_128, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_align_32_block_write_8_preload_96, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_align_32_block_write_16_preload_64, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_align_32_block_write_16_preload_96, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_align_32_block_write_16_preload_128, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_align_32_block_write_16_preload_160, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_align_32_block_write_16_preload_192, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_align_32_block_write_16_preload_256, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_align_32_block_write_32_preload_64, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_align_32_block_write_32_preload_96, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_align_32_block_write_32_preload_128, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_align_32_block_write_32_preload_160, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_align_32_block_write_32_preload_192, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_align_32_block_write_32_preload_256, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_align_32_block_write_16_preload_early_96, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_align_32_block_write_16_preload_early_128, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_align_32_block_write_16_preload_early_192, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_align_32_block_write_16_preload_early_256, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_align_32_block_write_32_preload_early_128, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_align_32_block_write_32_preload_early_192, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_align_32_block_write_32_preload_early_256, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_align_32_block_write_16_no_preload, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_align_32_block_write_32_no_preload, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_line_64_align_32_block_write_32_preload_early_128, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_line_64_align_32_block_write_32_preload_early_192, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_line_64_align_32_block_write_32_preload_early_256, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_line_64_align_32_block_write_32_preload_early_320, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_line_64_align_64_block_write_32_preload_early_256, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_no_overfetch_line_64_align_64_block_write_32_preload_early_320, 0),
+    MEMCPY_VARIANT(memcpy_armv5te_overfetch_align_16_block_write_16_preload_early_128, 1),
+    MEMCPY_VARIANT(memcpy_armv5te_overfetch_align_32_block_write_32_preload_early_192, 1),
+#endif
+};
+
+#define MEMCPY_NUM_VARIANTS \
+    (int)(sizeof(memcpy_variants) / sizeof(memcpy_variants[0]))
+
+#else
+
+/* There is nothing to choose from on other architectures */
+static const memcpy_variant_t *memcpy_variants = NULL;
+#define MEMCPY_NUM_VARIANTS 0
+
+#endif
+
+const char *memcpy_tune_name(cpu_memcpy_t func)
+{
+    int i;
+    for (i = 0; i < MEMCPY_NUM_VARIANTS; i++)
+        if (memcpy_variants[i].func == func)
+            return memcpy_variants[i].name;
+    return "unknown";
+}
+
+const char *memcpy_tune_source_name(int source)
+{
+    return memcpy_tune_source_names[source];
+}
+
+int memcpy_tune_num_variants(void)
+{
+    return MEMCPY_NUM_VARIANTS;
+}
+
+const memcpy_variant_t *memcpy_tune_variant(int i)
+{
+    return &memcpy_variants[i];
+}
+
+static const memcpy_variant_t *
+memcpy_tune_find(const char *name)
+{
+    int i;
+    for (i = 0; i < MEMCPY_NUM_VARIANTS; i++)
+        if (strcmp(memcpy_variants[i].name, name) == 0)
+            return &memcpy_variants[i];
+    return NULL;
+}
+
+static void
+memcpy_tune_key(cpu_backend_t *ctx, char *key, size_t size,
+                int xres, int yres, int bpp)
+{
+    cpuinfo_t *cpuinfo = ctx->cpuinfo;
+    snprintf(key, size, "%x:%x:%x:%x:%x %dx%dx%d",
+             cpuinfo ? cpuinfo->arm_implementer : 0,
+             cpuinfo ? cpuinfo->arm_architecture : 0,
+             cpuinfo ? cpuinfo->arm_variant : 0,
+             cpuinfo ? cpuinfo->arm_part : 0,
+             cpuinfo ? cpuinfo->arm_revision : 0,
+             xres, yres, bpp);
+}
+
+/* Returns 1 if the cache matches the key and names only known variants */
+static int
+memcpy_tune_load(cpu_backend_t *ctx, const char *cache_file, const char *key)
+{
+    cpu_memcpy_t no_overfetch[CPU_MEMCPY_NUM_SOURCES]
+                             [CPU_MEMCPY_NUM_SIZE_CLASSES];
+    cpu_memcpy_t overfetch[CPU_MEMCPY_NUM_SOURCES]
+                          [CPU_MEMCPY_NUM_SIZE_CLASSES];
+    /* The entries read, of the no_overfetch (0) and overfetch (1) tables */
+    char seen[2][CPU_MEMCPY_NUM_SOURCES][CPU_MEMCPY_NUM_SIZE_CLASSES];
+    char line[256], table[32], name[128];
+    int source, size_class, count = 0;
+    FILE *f = fopen(cache_file, "r");
+
+    if (!f)
+        return 0;
+
+    if (!fgets(line, sizeof(line), f) ||
+        strncmp(line, MEMCPY_TUNE_MAGIC "\n", sizeof(line)) != 0 ||
+        !fgets(line, sizeof(line), f) ||
+        strncmp(line, "key ", 4) != 0 ||
+        strcspn(line + 4, "\n") != strlen(key) ||
+        strncmp(line + 4, key, strlen(key)) != 0)
+    {
+        fclose(f);
+        return 0;
+    }
+
+    memset(seen, 0, sizeof(seen));
+    while (fgets(line, sizeof(line), f)) {
+        const memcpy_variant_t *variant;
+        int t;
+        if (sscanf(line, "%31s %d %d %127s", table, &source, &size_class,
+                   name) != 4 ||
+            source < 0 || source >= CPU_MEMCPY_NUM_SOURCES ||
+            size_class < 0 || size_class >= CPU_MEMCPY_NUM_SIZE_CLASSES ||
+            !(variant = memcpy_tune_find(name)))
+            break;
+        if (strcmp(table, "no_overfetch") == 0 && !variant->overfetch)
+            t = 0;
+        else if (strcmp(table, "overfetch") == 0)
+            t = 1;
+        else
+            break;
+        if (seen[t][source][size_class])
+            break;
+        seen[t][source][size_class] = 1;
+        if (t == 0)
+            no_overfetch[source][size_class] = variant->func;
+        else
+            overfetch[source][size_class] = variant->func;
+        count++;
+    }
+    fclose(f);
+
+    /*
+     * Every entry of both tables, exactly once: a repeated entry stops the
+     * parsing above, so a full count means that none is missing.
+     */
+    if (count != 2 * CPU_MEMCPY_NUM_SOURCES * CPU_MEMCPY_NUM_SIZE_CLASSES)
+        return 0;
+
+    memcpy(ctx->memcpy_no_overfetch, no_overfetch, sizeof(no_overfetch));
+    memcpy(ctx->memcpy_overfetch, overfetch, sizeof(overfetch));
+    return 1;
+}
+
+static void
+memcpy_tune_save(cpu_backend_t *ctx, const char *cache_file, const char *key)
+{
+    char tmp_file[1024];
+    int source, size_class;
+    FILE *f;
+
+    /* Write a temporary file first, so that the cache is never half written */
+    snprintf(tmp_file, sizeof(tmp_file), "%s.tmp", cache_file);
+    f = fopen(tmp_file, "w");
+    if (!f)
+        return;
+
+    fprintf(f, MEMCPY_TUNE_MAGIC "\nkey %s\n", key);
+    for (source = 0; source < CPU_MEMCPY_NUM_SOURCES; source++) {
+        for (size_class = 0; size_class < CPU_MEMCPY_NUM_SIZE_CLASSES;
+             size_class++) {
+            fprintf(f, "no_overfetch %d %d %s\n", source, size_class,
+                    memcpy_tune_name(
+                        ctx->memcpy_no_overfetch[source][size_class]));
+            fprintf(f, "overfetch %d %d %s\n", source, size_class,
+                    memcpy_tune_name(
+                        ctx->memcpy_overfetch[source][size_class]));
+        }
+    }
+
+    if (fclose(f) != 0 || rename(tmp_file, cache_file) != 0)
+        remove(tmp_file);
+}
+
+static double
+memcpy_tune_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * Returns the time per byte of a variant. The source is either the same
+ * framebuffer area as the destination or a copy of it in RAM, so that the
+ * framebuffer contents don't change.
+ */
+static double
+memcpy_tune_measure(cpu_memcpy_t func, uint8_t *fb_area, uint8_t *ram_area,
+                    int source, int size)
+{
+    uint8_t *src_area = source == CPU_MEMCPY_SRC_UNCACHED ? fb_area
+                                                          : ram_area;
+    double best = 0;
+    int run;
+
+    for (run = 0; run < MEMCPY_TUNE_RUNS; run++) {
+        long bytes = 0;
+        double start = memcpy_tune_time(), elapsed;
+        do {
+            int i;
+            for (i = 0; i < MEMCPY_TUNE_NUM_OFFSETS; i++) {
+                int offset = memcpy_tune_offsets[i];
+                func(fb_area + offset, src_area + offset, size);
+                bytes += size;
+            }
+            elapsed = memcpy_tune_time() - start;
+        } while (elapsed < MEMCPY_TUNE_MIN_TIME);
+        if (run == 0 || elapsed / bytes < best)
+            best = elapsed / bytes;
+    }
+    return best;
+}
+
+static void
+memcpy_tune_calibrate(cpu_backend_t *ctx, uint8_t *fb_area)
+{
+    uint8_t ram_area[MEMCPY_TUNE_AREA_SIZE];
+    int source, size_class, i;
+
+    memcpy(ram_area, fb_area, MEMCPY_TUNE_AREA_SIZE);
+
+    for (source = 0; source < CPU_MEMCPY_NUM_SOURCES; source++) {
+        for (size_class = 0; size_class < CPU_MEMCPY_NUM_SIZE_CLASSES;
+             size_class++) {
+            double best_no_overfetch = 0, best_overfetch = 0;
+            for (i = 0; i < MEMCPY_NUM_VARIANTS; i++) {
+                const memcpy_variant_t *variant = &memcpy_variants[i];
+                double t = memcpy_tune_measure(variant->func, fb_area,
+                               ram_area, source,
+                               memcpy_tune_sizes[size_class]);
+                /* The no_overfetch variants are also valid for overfetch */
+                if (best_overfetch == 0 || t < best_overfetch) {
+                    best_overfetch = t;
+                    ctx->memcpy_overfetch[source][size_class] = variant->func;
+                }
+                if (!variant->overfetch &&
+                    (best_no_overfetch == 0 || t < best_no_overfetch)) {
+                    best_no_overfetch = t;
+                    ctx->memcpy_no_overfetch[source][size_class] =
+                        variant->func;
+                }
+            }
+        }
+    }
+}
+
+int memcpy_tune(cpu_backend_t *ctx, const char *cache_file,
+                int xres, int yres, int bpp)
+{
+    char key[128];
+    uint8_t *fb_area = ctx->uncached_area_begin;
+
+    if (MEMCPY_NUM_VARIANTS == 0 ||
+        ctx->uncached_area_end - ctx->uncached_area_begin <
+            MEMCPY_TUNE_AREA_SIZE)
+        return MEMCPY_TUNE_FAILED;
+
+    memcpy_tune_key(ctx, key, sizeof(key), xres, yres, bpp);
+    if (cache_file && memcpy_tune_load(ctx, cache_file, key))
+        return MEMCPY_TUNE_CACHED;
+
+    memcpy_tune_calibrate(ctx, fb_area);
+    if (cache_file)
+        memcpy_tune_save(ctx, cache_file, key);
+    return MEMCPY_TUNE_CALIBRATED;
+}
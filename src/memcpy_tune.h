@@ -0,0 +1,70 @@
+/*
+ * Copyright © 2013 The xf86-video-rpifb authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef MEMCPY_TUNE_H
+#define MEMCPY_TUNE_H
+
+#include "cpu_backend.h"
+
+/*
+ * Startup calibration of the memcpy variants built in arm_asm.S.
+ *
+ * Every variant is timed for each size class of the dispatch tables in
+ * cpu_backend_t, once with the framebuffer as the source and once with
+ * ordinary RAM as the source, and the fastest one is installed. The
+ * framebuffer is always the destination, and its contents are preserved.
+ *
+ * The choice depends on the CPU and on the memory clocks, so it is cached
+ * in a small text file, keyed by the CPU id and the framebuffer geometry.
+ * Delete the file to force a new calibration (for example after changing
+ * the memory clock).
+ */
+
+/* The default location of the cache */
+#define MEMCPY_TUNE_CACHE_FILE "/var/lib/xorg/rpifb-memcpy-tune"
+
+enum {
+    MEMCPY_TUNE_FAILED,     /* not supported, the defaults are kept */
+    MEMCPY_TUNE_CACHED,     /* the variants were loaded from the cache */
+    MEMCPY_TUNE_CALIBRATED  /* the variants were timed (and cached) */
+};
+
+/* A memcpy variant, overfetch is set if it may read past the source */
+typedef struct {
+    const char   *name;
+    cpu_memcpy_t  func;
+    int           overfetch;
+} memcpy_variant_t;
+
+int memcpy_tune(cpu_backend_t *ctx, const char *cache_file,
+                int xres, int yres, int bpp);
+
+/* The names of a memcpy variant and of a kind of source memory, for logging */
+const char *memcpy_tune_name(cpu_memcpy_t func);
+const char *memcpy_tune_source_name(int source);
+
+/* The variants built into the driver, for the rpifb-memcpy benchmark */
+int memcpy_tune_num_variants(void);
+const memcpy_variant_t *memcpy_tune_variant(int i);
+
+#endif
@@ -0,0 +1,115 @@
+/*
+ * Copyright © 2013 The xf86-video-rpifb authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "rpi_adapt.h"
+
+static const char *rpi_adapt_decision_names[RPI_ADAPT_NUM_DECISIONS] = {
+    "cpu_blt"
+};
+
+static const char *rpi_adapt_dir_names[RPI_ADAPT_NUM_DIRS] = {
+    "none", "up", "down", "left", "right"
+};
+
+rpi_adapt_t *rpi_adapt_init(void)
+{
+    rpi_adapt_t *adapt = calloc(sizeof(rpi_adapt_t), 1);
+    if (!adapt)
+        return NULL;
+    adapt->countdown = RPI_ADAPT_SAMPLE_INTERVAL;
+    adapt->explore_countdown = RPI_ADAPT_EXPLORE_INTERVAL;
+    return adapt;
+}
+
+void rpi_adapt_close(rpi_adapt_t *adapt)
+{
+    free(adapt);
+}
+
+void rpi_adapt_update(rpi_adapt_t *adapt, int pixels)
+{
+    uint64_t cost = ((rpi_adapt_now() - adapt->start) << 8) /
+                    (pixels > 0 ? pixels : 1);
+    int i;
+
+    if (cost > UINT32_MAX)
+        cost = UINT32_MAX;
+    for (i = 0; i < adapt->npending; i++) {
+        rpi_adapt_cell_t *cell = adapt->pending[i];
+        int choice = adapt->pending_choice[i];
+        int64_t old_cost = cell->cost[choice];
+        if (cell->samples[choice] == 0)
+            cell->cost[choice] = cost;
+        else
+            cell->cost[choice] = old_cost + (((int64_t)cost - old_cost) >>
+                                             RPI_ADAPT_EWMA_SHIFT);
+        if (cell->samples[choice] < UINT32_MAX)
+            cell->samples[choice]++;
+    }
+    adapt->timing = 0;
+}
+
+void rpi_adapt_dump(const rpi_adapt_t *adapt,
+                    void (*print)(void *closure, const char *line),
+                    void *closure)
+{
+    char line[512];
+    int decision, bpp, dir, size, n;
+
+    for (decision = 0; decision < RPI_ADAPT_NUM_DECISIONS; decision++) {
+        for (bpp = 0; bpp < RPI_STATS_NUM_BPP; bpp++) {
+            for (dir = 0; dir < RPI_ADAPT_NUM_DIRS; dir++) {
+                int known = 0;
+                n = snprintf(line, sizeof(line), "adaptive %s %sbpp %s:",
+                             rpi_adapt_decision_names[decision],
+                             rpi_stats_bpp_names[bpp],
+                             rpi_adapt_dir_names[dir]);
+                for (size = 0; size < RPI_STATS_NUM_SIZE_BUCKETS &&
+                               n < (int)sizeof(line); size++) {
+                    const rpi_adapt_cell_t *cell =
+                        &adapt->cells[decision][bpp][dir][size];
+                    if (cell->samples[RPI_ADAPT_DECLINE] <
+                            RPI_ADAPT_MIN_SAMPLES ||
+                        cell->samples[RPI_ADAPT_ACCEPT] <
+                            RPI_ADAPT_MIN_SAMPLES)
+                        continue;
+                    /* size class, the choice and both costs in ns/pixel */
+                    n += snprintf(line + n, sizeof(line) - n,
+                                  " %d:%s(%.1f/%.1f)", size,
+                                  cell->cost[RPI_ADAPT_ACCEPT] <=
+                                  cell->cost[RPI_ADAPT_DECLINE] ?
+                                  "accept" : "decline",
+                                  cell->cost[RPI_ADAPT_ACCEPT] / 256.0,
+                                  cell->cost[RPI_ADAPT_DECLINE] / 256.0);
+                    known = 1;
+                }
+                if (known)
+                    print(closure, line);
+            }
+        }
+    }
+}
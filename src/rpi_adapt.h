@@ -0,0 +1,226 @@
+/*
+ * Copyright © 2013 The xf86-video-rpifb authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef RPI_ADAPT_H
+#define RPI_ADAPT_H
+
+#include <time.h>
+#include <inttypes.h>
+
+#include "rpi_stats.h"
+
+/*
+ * Adaptive dispatch thresholds. The blt2d_i implementations decide whether
+ * to take a request or to leave it to the next stage of the fallback chain
+ * by comparing its size with a compile-time threshold (for example
+ * ARM_BLT_WIDTH_THRESHOLD_*). When adaptation is enabled, they ask
+ * rpi_adapt_decide instead, which keeps a running cost estimate (an
+ * exponentially weighted moving average of nanoseconds per pixel) of both
+ * choices per decision, bpp, direction and size class, and picks the
+ * cheaper one. The compile-time threshold is used until both estimates
+ * are known.
+ *
+ * The estimates are fed by rpi_x.c, which times one in every
+ * RPI_ADAPT_SAMPLE_INTERVAL boxes. One in every RPI_ADAPT_EXPLORE_INTERVAL
+ * timed boxes takes the other choice, so that the estimate of the choice
+ * which currently loses stays up to date.
+ */
+
+#define RPI_ADAPT_SAMPLE_INTERVAL  16
+#define RPI_ADAPT_EXPLORE_INTERVAL 8
+/* Samples of each choice needed before the estimates are trusted */
+#define RPI_ADAPT_MIN_SAMPLES      4
+/* The weight of a new sample in the moving average is 1 / 2^shift */
+#define RPI_ADAPT_EWMA_SHIFT       3
+
+/*
+ * The decisions which are adapted. Only those whose accept path is
+ * implemented: the size thresholds of rpi_blt and rpi_fill only decide
+ * between fallbacks as long as these are stubs.
+ */
+enum {
+    RPI_ADAPT_CPU_BLT,   /* ARM_BLT_WIDTH_THRESHOLD_* in overlapped_blt_arm */
+    RPI_ADAPT_NUM_DECISIONS
+};
+
+/* The direction of a copy within one buffer */
+enum {
+    RPI_ADAPT_DIR_NONE,  /* fills and copies between different buffers */
+    RPI_ADAPT_DIR_UP,
+    RPI_ADAPT_DIR_DOWN,
+    RPI_ADAPT_DIR_LEFT,
+    RPI_ADAPT_DIR_RIGHT,
+    RPI_ADAPT_NUM_DIRS
+};
+
+enum {
+    RPI_ADAPT_DECLINE,
+    RPI_ADAPT_ACCEPT,
+    RPI_ADAPT_NUM_CHOICES
+};
+
+/* The decisions timed per box, one per stage of the fallback chain */
+#define RPI_ADAPT_MAX_PENDING 2
+
+typedef struct {
+    uint32_t cost[RPI_ADAPT_NUM_CHOICES];    /* ns per pixel, 8.8 fixed point */
+    uint32_t samples[RPI_ADAPT_NUM_CHOICES];
+} rpi_adapt_cell_t;
+
+typedef struct {
+    int               countdown;
+    int               explore_countdown;
+    /* The state of the box being timed */
+    int               timing;
+    int               exploring;
+    uint64_t          start;
+    int               npending;
+    rpi_adapt_cell_t *pending[RPI_ADAPT_MAX_PENDING];
+    int               pending_choice[RPI_ADAPT_MAX_PENDING];
+    /*
+     * The size classes are the area buckets of the statistics, or the
+     * log2 of the width for the width thresholds.
+     */
+    rpi_adapt_cell_t  cells[RPI_ADAPT_NUM_DECISIONS][RPI_STATS_NUM_BPP]
+                           [RPI_ADAPT_NUM_DIRS][RPI_STATS_NUM_SIZE_BUCKETS];
+} rpi_adapt_t;
+
+rpi_adapt_t *rpi_adapt_init(void);
+void rpi_adapt_close(rpi_adapt_t *adapt);
+
+/*
+ * Write the choices learned so far, one line per decision, bpp and
+ * direction, through the print callback.
+ */
+void rpi_adapt_dump(const rpi_adapt_t *adapt,
+                    void (*print)(void *closure, const char *line),
+                    void *closure);
+
+static inline uint64_t
+rpi_adapt_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline int
+rpi_adapt_direction(uint32_t *src_bits, uint32_t *dst_bits,
+                    int src_x, int src_y, int dst_x, int dst_y)
+{
+    if (src_bits != dst_bits)
+        return RPI_ADAPT_DIR_NONE;
+    if (src_y > dst_y)
+        return RPI_ADAPT_DIR_UP;
+    if (src_y < dst_y)
+        return RPI_ADAPT_DIR_DOWN;
+    if (src_x < dst_x)
+        return RPI_ADAPT_DIR_RIGHT;
+    return RPI_ADAPT_DIR_LEFT;
+}
+
+static inline int
+rpi_adapt_width_class(int w)
+{
+    int size = 0;
+    while (w >= 2 && size < RPI_STATS_NUM_SIZE_BUCKETS - 1) {
+        w >>= 1;
+        size++;
+    }
+    return size;
+}
+
+/*
+ * Returns nonzero if the implementation should take the request, given
+ * the compile-time choice accept_default.
+ */
+static inline int
+rpi_adapt_decide(rpi_adapt_t *adapt, int decision, int bpp, int dir,
+                 int size, int accept_default)
+{
+    rpi_adapt_cell_t *cell =
+        &adapt->cells[decision][rpi_stats_bpp_index(bpp)][dir][size];
+    int accept = accept_default;
+
+    if (cell->samples[RPI_ADAPT_DECLINE] >= RPI_ADAPT_MIN_SAMPLES &&
+        cell->samples[RPI_ADAPT_ACCEPT] >= RPI_ADAPT_MIN_SAMPLES)
+        accept = cell->cost[RPI_ADAPT_ACCEPT] <= cell->cost[RPI_ADAPT_DECLINE];
+
+    if (adapt->timing) {
+        if (adapt->exploring)
+            accept = !accept;
+        if (adapt->npending < RPI_ADAPT_MAX_PENDING) {
+            adapt->pending[adapt->npending] = cell;
+            adapt->pending_choice[adapt->npending] = accept;
+            adapt->npending++;
+        }
+    }
+    return accept;
+}
+
+/* Call before a box is drawn, starts timing one in every sample interval */
+static inline void
+rpi_adapt_begin(rpi_adapt_t *adapt)
+{
+    if (--adapt->countdown > 0)
+        return;
+    adapt->countdown = RPI_ADAPT_SAMPLE_INTERVAL;
+    adapt->timing = 1;
+    adapt->npending = 0;
+    adapt->exploring = 0;
+    if (--adapt->explore_countdown <= 0) {
+        adapt->explore_countdown = RPI_ADAPT_EXPLORE_INTERVAL;
+        adapt->exploring = 1;
+    }
+    adapt->start = rpi_adapt_now();
+}
+
+void rpi_adapt_update(rpi_adapt_t *adapt, int pixels);
+
+/* Call after a box is drawn, feeds the time to the pending decisions */
+static inline void
+rpi_adapt_end(rpi_adapt_t *adapt, int w, int h)
+{
+    if (adapt->timing)
+        rpi_adapt_update(adapt, w * h);
+}
+
+/* Only adapt if adaptation is enabled */
+#define RPI_ADAPT_DECIDE(adapt, decision, bpp, dir, size, accept_default) \
+    ((adapt) ? rpi_adapt_decide(adapt, decision, bpp, dir, size, \
+                                accept_default) \
+             : (accept_default))
+
+#define RPI_ADAPT_BEGIN(adapt) \
+    do { \
+        if (adapt) \
+            rpi_adapt_begin(adapt); \
+    } while (0)
+
+#define RPI_ADAPT_END(adapt, w, h) \
+    do { \
+        if (adapt) \
+            rpi_adapt_end(adapt, w, h); \
+    } while (0)
+
+#endif
@@ -155,6 +155,51 @@ rpi_disp_t *rpi_disp_init(const char *device, void *xserver_fbmem)
     ctx->blt2d.overlapped_blt = rpi_blt;
     ctx->blt2d.standard_blt = NULL;
     ctx->blt2d.fill = rpi_fill;
+    ctx->blt2d.overlapped_blt_route = rpi_blt_route;
+
+    return ctx;
+}
+
+/*
+ * Set up a display context on top of an ordinary memory buffer instead
+ * of a framebuffer device. This is used by the standalone benchmark and
+ * replay tools, which need the same framebuffer range checks as the
+ * driver, but can't rely on the hardware being present.
+ */
+rpi_disp_t *rpi_disp_init_memory(void *fbmem, int xres, int yres,
+                                 int bits_per_pixel, uint32_t size)
+{
+    rpi_disp_t *ctx;
+
+    if (!fbmem || size < (uint32_t)xres * yres * bits_per_pixel / 8)
+        return NULL;
+
+    ctx = calloc(sizeof(rpi_disp_t), 1);
+    if (!ctx)
+        return NULL;
+
+    ctx->fd_fb = -1;
+    ctx->fd_disp = -1;
+    ctx->fd_g2d = -1;
+    ctx->xres = xres;
+    ctx->yres = yres;
+    ctx->bits_per_pixel = bits_per_pixel;
+    ctx->framebuffer_size = size;
+    ctx->framebuffer_height = size / (xres * bits_per_pixel / 8);
+    ctx->gfx_layer_size = xres * yres * bits_per_pixel / 8;
+    /* the buffer is owned by the caller, so it must not be unmapped */
+    ctx->xserver_fbmem = fbmem;
+    ctx->framebuffer_addr = fbmem;
+
+    ctx->cursor_enabled = 0;
+    ctx->cursor_x = -1;
+    ctx->cursor_y = -1;
+
+    ctx->blt2d.self = ctx;
+    ctx->blt2d.overlapped_blt = rpi_blt;
+    ctx->blt2d.standard_blt = NULL;
+    ctx->blt2d.fill = rpi_fill;
+    ctx->blt2d.overlapped_blt_route = rpi_blt_route;
 
     return ctx;
 }
@@ -175,7 +220,8 @@ int rpi_disp_close(rpi_disp_t *ctx)
         /* close descriptors */
         if (!ctx->xserver_fbmem)
             munmap(ctx->framebuffer_addr, ctx->framebuffer_size);
-        close(ctx->fd_fb);
+        if (ctx->fd_fb >= 0)
+            close(ctx->fd_fb);
 //        close(ctx->fd_disp);
 //        ctx->fd_disp = -1;
         free(ctx);
@@ -441,9 +487,6 @@ int rpi_fill(      void               *self,
     if (w <= 0 || h <= 0)
         return 1;
 
-    /* Not implemented. */
-    return 0;
-
     /*
      * Very minimal validation here. We just assume that if the beginning
      * of the destination image belongs to the framebuffer,
@@ -452,6 +495,8 @@ int rpi_fill(      void               *self,
     if ((uint8_t *)bits < disp->framebuffer_addr ||
         (uint8_t *)bits >= disp->framebuffer_addr + disp->framebuffer_size)
     {
+        RPI_STATS_FALLBACK(disp->stats, RPI_STATS_REASON_OUTSIDE_FRAMEBUFFER,
+                           bpp, w, h);
         return 0;
     }
 
@@ -465,8 +510,16 @@ int rpi_fill(      void               *self,
         blt_size_threshold = RPI_FILL_SIZE_THRESHOLD_16BPP;
     else
         blt_size_threshold = RPI_FILL_SIZE_THRESHOLD_32BPP;
-    if (w * h < blt_size_threshold)
+    if (w * h < blt_size_threshold) {
+        RPI_STATS_FALLBACK(disp->stats, RPI_STATS_REASON_SIZE_THRESHOLD,
+                           bpp, w, h);
         return 0;
+    }
+
+    /* Not implemented. */
+    RPI_STATS_FALLBACK(disp->stats, RPI_STATS_REASON_NOT_IMPLEMENTED,
+                       bpp, w, h);
+    return 0;
 }
 
 /*
@@ -507,15 +560,14 @@ int rpi_blt(void               *self,
         (uint8_t *)dst_bits < disp->framebuffer_addr ||
         (uint8_t *)dst_bits >= disp->framebuffer_addr + disp->framebuffer_size)
     {
+        RPI_STATS_FALLBACK(disp->stats, RPI_STATS_REASON_OUTSIDE_FRAMEBUFFER,
+                           dst_bpp, w, h);
         return 0;
     }
 
     if (w <= 0 || h <= 0)
         return 1;
 
-    /* Not implemented. */
-    return 0;
-
     /*
      * If the area is smaller than RPI_BLT_SIZE_THRESHOLD, prefer to avoid the
      * overhead of accelerated blit and do a CPU blit instead. There is a special
@@ -525,6 +577,33 @@ int rpi_blt(void               *self,
         blt_size_threshold = RPI_BLT_SIZE_THRESHOLD_16BPP;
     else
         blt_size_threshold = RPI_BLT_SIZE_THRESHOLD;
-    if (w * h < blt_size_threshold)
+    if (w * h < blt_size_threshold) {
+        RPI_STATS_FALLBACK(disp->stats, RPI_STATS_REASON_SIZE_THRESHOLD,
+                           dst_bpp, w, h);
         return 0;
+    }
+
+    /* Not implemented. */
+    RPI_STATS_FALLBACK(disp->stats, RPI_STATS_REASON_NOT_IMPLEMENTED,
+                       dst_bpp, w, h);
+    return 0;
+}
+
+/*
+ * Dispatch hint for rpi_blt, which must agree with the checks above. The
+ * accelerated blit is not implemented, so every request is declined.
+ */
+int rpi_blt_route(void               *self,
+                  uint32_t           *src_bits,
+                  uint32_t           *dst_bits,
+                  int                 src_stride,
+                  int                 dst_stride,
+                  int                 src_bpp,
+                  int                 dst_bpp,
+                  int                 reverse,
+                  int                 upsidedown,
+                  int                 min_w,
+                  int                 max_w)
+{
+    return BLT2D_ROUTE_NEVER;
 }
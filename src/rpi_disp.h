@@ -30,6 +30,7 @@
 #include <inttypes.h>
 
 #include "interfaces.h"
+#include "rpi_stats.h"
 
 /*
  * Support for RPi hardware features.
@@ -59,9 +60,13 @@ typedef struct {
 
     /* Acelerated implementation of blt2d_i interface */
     blt2d_i             blt2d;
+    /* Where to record the reasons for declined requests (may be NULL) */
+    rpi_stats_t        *stats;
 } rpi_disp_t;
 
 rpi_disp_t *rpi_disp_init(const char *fb_device, void *xserver_fbmem);
+rpi_disp_t *rpi_disp_init_memory(void *fbmem, int xres, int yres,
+                                 int bits_per_pixel, uint32_t size);
 int rpi_disp_close(rpi_disp_t *ctx);
 
 #if 0
@@ -148,4 +153,17 @@ int rpi_blt(void               *disp,
                   int                 w,
                   int                 h);
 
+/* The overlapped_blt_route hint for rpi_blt */
+int rpi_blt_route(void               *self,
+                  uint32_t           *src_bits,
+                  uint32_t           *dst_bits,
+                  int                 src_stride,
+                  int                 dst_stride,
+                  int                 src_bpp,
+                  int                 dst_bpp,
+                  int                 reverse,
+                  int                 upsidedown,
+                  int                 min_w,
+                  int                 max_w);
+
 #endif
@@ -0,0 +1,137 @@
+/*
+ * Copyright © 2013 The xf86-video-rpifb authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "rpi_latency.h"
+
+volatile sig_atomic_t rpi_latency_dump_requested;
+
+static void
+rpi_latency_sigusr2(int sig)
+{
+    rpi_latency_dump_requested = 1;
+}
+
+rpi_latency_t *rpi_latency_init(int sample_interval)
+{
+    struct sigaction action;
+    rpi_latency_t *latency = calloc(sizeof(rpi_latency_t), 1);
+    if (!latency)
+        return NULL;
+
+    latency->sample_interval = sample_interval > 0 ? sample_interval : 1;
+    latency->countdown = latency->sample_interval;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = rpi_latency_sigusr2;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    if (sigaction(SIGUSR2, &action, &latency->old_sigusr2) < 0) {
+        free(latency);
+        return NULL;
+    }
+
+    return latency;
+}
+
+void rpi_latency_close(rpi_latency_t *latency)
+{
+    sigaction(SIGUSR2, &latency->old_sigusr2, NULL);
+    free(latency);
+}
+
+/*
+ * An estimate of the given percentile: the upper bound of the bucket
+ * which holds it, or the maximum if that is lower.
+ */
+static uint32_t
+rpi_latency_percentile(const rpi_latency_histogram_t *histogram,
+                       int percent)
+{
+    uint64_t target = ((uint64_t)histogram->count * percent + 99) / 100;
+    uint64_t seen = 0;
+    int bucket;
+
+    for (bucket = 0; bucket < RPI_LATENCY_NUM_BUCKETS - 1; bucket++) {
+        seen += histogram->buckets[bucket];
+        if (seen >= target)
+            break;
+    }
+    if (bucket == RPI_LATENCY_NUM_BUCKETS - 1 ||
+        histogram->max_us < (1U << bucket))
+        return histogram->max_us;
+    return 1U << bucket;
+}
+
+void rpi_latency_dump(const rpi_latency_t *latency,
+                      void (*print)(void *closure, const char *line),
+                      void *closure)
+{
+    char line[512];
+    int op, size, bucket, n;
+
+    snprintf(line, sizeof(line),
+             "latency histograms, 1 in %d calls timed, sizes are "
+             "areas in pixels, buckets are upper bounds in us",
+             latency->sample_interval);
+    print(closure, line);
+
+    for (op = 0; op < RPI_STATS_NUM_OPS; op++) {
+        for (size = 0; size < RPI_STATS_NUM_SIZE_BUCKETS; size++) {
+            const rpi_latency_histogram_t *histogram =
+                &latency->histograms[op][size];
+            if (histogram->count == 0)
+                continue;
+
+            if (size == RPI_STATS_NUM_SIZE_BUCKETS - 1)
+                n = snprintf(line, sizeof(line), "%s area %u+:",
+                             rpi_stats_op_names[op], 1U << (2 * size));
+            else
+                n = snprintf(line, sizeof(line), "%s area %u-%u:",
+                             rpi_stats_op_names[op], size ? 1U << (2 * size) : 0,
+                             (1U << (2 * size + 2)) - 1);
+            n += snprintf(line + n, sizeof(line) - n,
+                         " n=%u p50<=%u p99<=%u max=%u us |",
+                         histogram->count,
+                         rpi_latency_percentile(histogram, 50),
+                         rpi_latency_percentile(histogram, 99),
+                         histogram->max_us);
+            for (bucket = 0; bucket < RPI_LATENCY_NUM_BUCKETS &&
+                             n < (int)sizeof(line); bucket++) {
+                if (histogram->buckets[bucket] == 0)
+                    continue;
+                if (bucket == RPI_LATENCY_NUM_BUCKETS - 1)
+                    n += snprintf(line + n, sizeof(line) - n, " >=%u:%u",
+                                  1U << (bucket - 1),
+                                  histogram->buckets[bucket]);
+                else
+                    n += snprintf(line + n, sizeof(line) - n, " <%u:%u",
+                                  1U << bucket, histogram->buckets[bucket]);
+            }
+            print(closure, line);
+        }
+    }
+}
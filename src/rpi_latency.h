@@ -0,0 +1,122 @@
+/*
+ * Copyright © 2013 The xf86-video-rpifb authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef RPI_LATENCY_H
+#define RPI_LATENCY_H
+
+#include <signal.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include "rpi_stats.h"
+
+/*
+ * Latency histograms of the hooked operations. One call out of every
+ * sample_interval calls is timed with the monotonic clock (which is a
+ * vDSO call, the ARM11 cycle counter isn't readable from user space by
+ * default). The latency goes into a log2 bucketed histogram per operation
+ * and per size class, which uses the same area buckets as the fallback
+ * statistics.
+ *
+ * The histograms are dumped on SIGUSR2 (at the next timed call, the
+ * signal handler only sets a flag) and when the screen is closed. Not on
+ * SIGUSR1, with which the Linux console asks the server to switch VTs.
+ */
+
+/* Bucket 0 holds latencies below 1 us, bucket i the range [2^(i-1), 2^i) us */
+#define RPI_LATENCY_NUM_BUCKETS 20
+
+typedef struct {
+    uint32_t count;
+    uint32_t max_us;
+    uint32_t buckets[RPI_LATENCY_NUM_BUCKETS];
+} rpi_latency_histogram_t;
+
+typedef struct {
+    int                     sample_interval;
+    int                     countdown;
+    struct sigaction        old_sigusr2;
+    rpi_latency_histogram_t histograms[RPI_STATS_NUM_OPS]
+                                      [RPI_STATS_NUM_SIZE_BUCKETS];
+} rpi_latency_t;
+
+/* Set by the SIGUSR2 handler */
+extern volatile sig_atomic_t rpi_latency_dump_requested;
+
+rpi_latency_t *rpi_latency_init(int sample_interval);
+void rpi_latency_close(rpi_latency_t *latency);
+
+/*
+ * Write the non-empty histograms, one line per operation and size class,
+ * through the print callback.
+ */
+void rpi_latency_dump(const rpi_latency_t *latency,
+                      void (*print)(void *closure, const char *line),
+                      void *closure);
+
+static inline uint64_t
+rpi_latency_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Returns nonzero if this call should be timed */
+static inline int
+rpi_latency_sample(rpi_latency_t *latency)
+{
+    if (--latency->countdown > 0)
+        return 0;
+    latency->countdown = latency->sample_interval;
+    return 1;
+}
+
+static inline int
+rpi_latency_bucket(uint32_t us)
+{
+    int bucket = 0;
+    while (us > 0 && bucket < RPI_LATENCY_NUM_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+/* Add a timed call, the size is the total area drawn */
+static inline void
+rpi_latency_add(rpi_latency_t *latency, int op, int w, int h, uint64_t start)
+{
+    uint64_t us = (rpi_latency_now() - start) / 1000;
+    rpi_latency_histogram_t *histogram =
+        &latency->histograms[op][rpi_stats_size_bucket(w, h)];
+
+    if (us > UINT32_MAX)
+        us = UINT32_MAX;
+    histogram->count++;
+    if (us > histogram->max_us)
+        histogram->max_us = us;
+    histogram->buckets[rpi_latency_bucket(us)]++;
+}
+
+#endif
@@ -0,0 +1,138 @@
+/*
+ * Copyright © 2013 The xf86-video-rpifb authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "rpi_stats.h"
+
+const char *rpi_stats_op_names[RPI_STATS_NUM_OPS] = {
+    "CopyArea",
+    "CopyWindow",
+    "PutImage",
+    "PolyFillRect",
+    "PolyLine",
+    "PolyFillArc",
+    "FillSpans",
+    "SetSpans",
+    "GetImage"
+};
+
+const char *rpi_stats_stage_names[RPI_STATS_NUM_STAGES] = {
+    "small",
+    "line",
+    "span",
+    "accel",
+    "cpu_backend",
+    "standard_blt",
+    "pixman",
+    "fb"
+};
+
+const char *rpi_stats_reason_names[RPI_STATS_NUM_REASONS] = {
+    "width_threshold",
+    "cached_source",
+    "bpp_mismatch",
+    "negative_stride",
+    "outside_framebuffer",
+    "size_threshold",
+    "not_implemented"
+};
+
+const char *rpi_stats_bpp_names[RPI_STATS_NUM_BPP] = {
+    "8", "16", "24", "32", "other"
+};
+
+rpi_stats_t *rpi_stats_init(const char *name)
+{
+    rpi_stats_t *stats;
+    int fd;
+
+    fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return NULL;
+
+    if (ftruncate(fd, sizeof(rpi_stats_t)) < 0) {
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+
+    stats = mmap(0, sizeof(rpi_stats_t), PROT_READ | PROT_WRITE,
+                 MAP_SHARED, fd, 0);
+    close(fd);
+    if (stats == MAP_FAILED) {
+        shm_unlink(name);
+        return NULL;
+    }
+
+    memset(stats, 0, sizeof(rpi_stats_t));
+    stats->version = RPI_STATS_VERSION;
+    stats->size = sizeof(rpi_stats_t);
+    stats->pid = getpid();
+    /* Set the magic last, so that readers never see a half-initialized segment */
+    stats->magic = RPI_STATS_MAGIC;
+
+    return stats;
+}
+
+void rpi_stats_close(rpi_stats_t *stats, const char *name)
+{
+    munmap(stats, sizeof(rpi_stats_t));
+    shm_unlink(name);
+}
+
+const rpi_stats_t *rpi_stats_open(const char *name)
+{
+    const rpi_stats_t *stats;
+    struct stat st;
+    int fd;
+
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return NULL;
+
+    if (fstat(fd, &st) < 0 || st.st_size < sizeof(rpi_stats_t)) {
+        close(fd);
+        return NULL;
+    }
+
+    stats = mmap(0, sizeof(rpi_stats_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (stats == MAP_FAILED)
+        return NULL;
+
+    if (stats->magic != RPI_STATS_MAGIC ||
+        stats->version != RPI_STATS_VERSION ||
+        stats->size != sizeof(rpi_stats_t))
+    {
+        munmap((void *)stats, sizeof(rpi_stats_t));
+        return NULL;
+    }
+
+    return stats;
+}
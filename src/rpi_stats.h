@@ -0,0 +1,182 @@
+/*
+ * Copyright © 2013 The xf86-video-rpifb authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef RPI_STATS_H
+#define RPI_STATS_H
+
+#include <inttypes.h>
+
+/*
+ * Statistics about which stage of the fallback chain in rpi_x.c did the
+ * work for each hooked operation, and about the reasons why the blt2d_i
+ * implementations declined requests. The statistics live in a POSIX shared
+ * memory segment, so that they can be inspected live by the rpifb-stats
+ * tool. The counters are updated without any locking, a reader may see
+ * slightly inconsistent values while the X server is drawing.
+ */
+
+#define RPI_STATS_MAGIC   0x52504953 /* "RPIS" */
+#define RPI_STATS_VERSION 7
+
+/* The name of the segment is RPI_STATS_SHM_PREFIX followed by the display */
+#define RPI_STATS_SHM_PREFIX "/rpifb-stats-"
+
+/* The hooked operations */
+enum {
+    RPI_STATS_OP_COPY_AREA,
+    RPI_STATS_OP_COPY_WINDOW,
+    RPI_STATS_OP_PUT_IMAGE,
+    RPI_STATS_OP_POLY_FILL_RECT,
+    RPI_STATS_OP_POLY_LINE,       /* PolySegment, PolyLine, PolyRectangle */
+    RPI_STATS_OP_POLY_FILL_ARC,
+    RPI_STATS_OP_FILL_SPANS,
+    RPI_STATS_OP_SET_SPANS,
+    RPI_STATS_OP_GET_IMAGE,
+    RPI_STATS_NUM_OPS
+};
+
+/* The stages of the fallback chain */
+enum {
+    RPI_STATS_STAGE_SMALL,        /* the small_blt.h kernels */
+    RPI_STATS_STAGE_LINE,         /* the zero_line.h kernels */
+    RPI_STATS_STAGE_SPAN,         /* the pattern and image row copies */
+    RPI_STATS_STAGE_ACCEL,        /* blt2d_overlapped_blt or blt2d_fill */
+    RPI_STATS_STAGE_CPU_BACKEND,  /* blt2d_cpu_backend */
+    RPI_STATS_STAGE_STANDARD_BLT, /* blt2d_standard_blt */
+    RPI_STATS_STAGE_PIXMAN,       /* pixman_blt or pixman_fill */
+    RPI_STATS_STAGE_FB,           /* fbBlt or fbSolid */
+    RPI_STATS_NUM_STAGES
+};
+
+/* The reasons for a blt2d_i implementation to decline a request */
+enum {
+    RPI_STATS_REASON_WIDTH_THRESHOLD,     /* ARM_BLT_WIDTH_THRESHOLD_* */
+    RPI_STATS_REASON_CACHED_SOURCE,       /* source outside the uncached area */
+    RPI_STATS_REASON_BPP_MISMATCH,        /* different or unsupported bpp */
+    RPI_STATS_REASON_NEGATIVE_STRIDE,
+    RPI_STATS_REASON_OUTSIDE_FRAMEBUFFER, /* rpi_blt/rpi_fill range check */
+    RPI_STATS_REASON_SIZE_THRESHOLD,      /* RPI_BLT/FILL_SIZE_THRESHOLD_* */
+    RPI_STATS_REASON_NOT_IMPLEMENTED,
+    RPI_STATS_NUM_REASONS
+};
+
+/* Fallbacks are also keyed by bpp (8, 16, 24, 32 or other) */
+#define RPI_STATS_NUM_BPP 5
+
+/*
+ * ... and by the area of the request: size bucket i holds the areas in
+ * the range [4^i, 4^(i+1)), so roughly squares with sides from 2^i to
+ * 2^(i+1). The last bucket is open ended.
+ */
+#define RPI_STATS_NUM_SIZE_BUCKETS 10
+
+typedef struct {
+    uint64_t calls;
+    uint64_t pixels;
+    uint64_t bytes;
+} rpi_stats_counter_t;
+
+typedef struct {
+    uint32_t            magic;
+    uint32_t            version;
+    uint32_t            size;     /* sizeof(rpi_stats_t) */
+    int32_t             pid;      /* the X server which owns the segment */
+    rpi_stats_counter_t dispatch[RPI_STATS_NUM_OPS][RPI_STATS_NUM_STAGES];
+    uint64_t            fallbacks[RPI_STATS_NUM_REASONS][RPI_STATS_NUM_BPP]
+                                 [RPI_STATS_NUM_SIZE_BUCKETS];
+} rpi_stats_t;
+
+extern const char *rpi_stats_op_names[RPI_STATS_NUM_OPS];
+extern const char *rpi_stats_stage_names[RPI_STATS_NUM_STAGES];
+extern const char *rpi_stats_reason_names[RPI_STATS_NUM_REASONS];
+extern const char *rpi_stats_bpp_names[RPI_STATS_NUM_BPP];
+
+/*
+ * Create (or take over) the shared memory segment with the given name
+ * and reset all the counters. Returns NULL on failure.
+ */
+rpi_stats_t *rpi_stats_init(const char *name);
+void rpi_stats_close(rpi_stats_t *stats, const char *name);
+
+/* Map an existing segment read-only, for the rpifb-stats tool */
+const rpi_stats_t *rpi_stats_open(const char *name);
+
+static inline void
+rpi_stats_count(rpi_stats_t *stats, int op, int stage, int w, int h, int bpp)
+{
+    rpi_stats_counter_t *counter = &stats->dispatch[op][stage];
+    uint64_t pixels = (uint64_t)w * h;
+    counter->calls++;
+    counter->pixels += pixels;
+    counter->bytes += pixels * bpp >> 3;
+}
+
+static inline int
+rpi_stats_bpp_index(int bpp)
+{
+    switch (bpp) {
+    case 8:
+        return 0;
+    case 16:
+        return 1;
+    case 24:
+        return 2;
+    case 32:
+        return 3;
+    }
+    return 4;
+}
+
+static inline int
+rpi_stats_size_bucket(int w, int h)
+{
+    uint32_t area = (w > 0 && h > 0) ? (uint32_t)w * h : 0;
+    int bucket = 0;
+    while (area >= 4 && bucket < RPI_STATS_NUM_SIZE_BUCKETS - 1) {
+        area >>= 2;
+        bucket++;
+    }
+    return bucket;
+}
+
+static inline void
+rpi_stats_fallback(rpi_stats_t *stats, int reason, int bpp, int w, int h)
+{
+    stats->fallbacks[reason][rpi_stats_bpp_index(bpp)]
+                    [rpi_stats_size_bucket(w, h)]++;
+}
+
+/* Only count if the statistics are enabled */
+#define RPI_STATS_COUNT(stats, op, stage, w, h, bpp) \
+    do { \
+        if (stats) \
+            rpi_stats_count(stats, op, stage, w, h, bpp); \
+    } while (0)
+
+#define RPI_STATS_FALLBACK(stats, reason, bpp, w, h) \
+    do { \
+        if (stats) \
+            rpi_stats_fallback(stats, reason, bpp, w, h); \
+    } while (0)
+
+#endif
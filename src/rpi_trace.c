@@ -0,0 +1,144 @@
+/*
+ * Copyright © 2013 The xf86-video-rpifb authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "rpi_trace.h"
+
+/* Use a large stdio buffer, the trace is written from the drawing hooks */
+#define TRACE_BUFFER_SIZE (256 * 1024)
+
+rpi_trace_t *rpi_trace_open(const char *filename, int width, int height,
+                            int bpp, int hash_images)
+{
+    rpi_trace_header_t header;
+    rpi_trace_t *trace = calloc(sizeof(rpi_trace_t), 1);
+    if (!trace)
+        return NULL;
+
+    trace->file = fopen(filename, "wb");
+    if (!trace->file) {
+        free(trace);
+        return NULL;
+    }
+    setvbuf(trace->file, NULL, _IOFBF, TRACE_BUFFER_SIZE);
+    trace->hash_images = hash_images;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = RPI_TRACE_MAGIC;
+    header.version = RPI_TRACE_VERSION;
+    header.width = width;
+    header.height = height;
+    header.bpp = bpp;
+    if (fwrite(&header, sizeof(header), 1, trace->file) != 1) {
+        fclose(trace->file);
+        free(trace);
+        return NULL;
+    }
+
+    return trace;
+}
+
+int rpi_trace_close(rpi_trace_t *trace)
+{
+    int ok = fclose(trace->file) == 0 && !trace->failed;
+    free(trace->boxes);
+    free(trace);
+    return ok;
+}
+
+void rpi_trace_begin(rpi_trace_t *trace, int op, int bpp, int src_kind,
+                     int dst_kind, int flags, int dx, int dy,
+                     int src_width, int src_height, uint32_t color)
+{
+    rpi_trace_record_t *record = &trace->record;
+    memset(record, 0, sizeof(*record));
+    record->op = op;
+    record->bpp = bpp;
+    record->src_kind = src_kind;
+    record->dst_kind = dst_kind;
+    record->flags = flags;
+    record->dx = dx;
+    record->dy = dy;
+    record->src_width = src_width;
+    record->src_height = src_height;
+    record->color = color;
+}
+
+void rpi_trace_add_box(rpi_trace_t *trace, int x1, int y1, int x2, int y2)
+{
+    rpi_trace_box_t *box;
+
+    /* The box count is 16-bit, start a continuation record when it's full */
+    if (trace->record.nbox == UINT16_MAX) {
+        rpi_trace_record_t record = trace->record;
+        rpi_trace_end(trace);
+        trace->record = record;
+        trace->record.nbox = 0;
+    }
+
+    if (trace->record.nbox >= trace->boxes_size) {
+        int size = trace->boxes_size ? trace->boxes_size * 2 : 64;
+        rpi_trace_box_t *boxes = realloc(trace->boxes,
+                                         size * sizeof(rpi_trace_box_t));
+        if (!boxes) {
+            trace->failed = 1;
+            return;
+        }
+        trace->boxes = boxes;
+        trace->boxes_size = size;
+    }
+
+    box = &trace->boxes[trace->record.nbox++];
+    box->x1 = x1;
+    box->y1 = y1;
+    box->x2 = x2;
+    box->y2 = y2;
+}
+
+int rpi_trace_end(rpi_trace_t *trace)
+{
+    size_t nbox = trace->record.nbox;
+
+    if (nbox != 0 && !trace->failed &&
+        (fwrite(&trace->record, sizeof(rpi_trace_record_t), 1,
+                trace->file) != 1 ||
+         fwrite(trace->boxes, sizeof(rpi_trace_box_t), nbox,
+                trace->file) != nbox))
+        trace->failed = 1;
+    trace->record.nbox = 0;
+    return !trace->failed;
+}
+
+uint32_t rpi_trace_hash(const void *data, size_t size)
+{
+    const uint8_t *p = data;
+    uint32_t hash = 2166136261U;
+    while (size--) {
+        hash ^= *p++;
+        hash *= 16777619U;
+    }
+    return hash;
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright © 2013 The xf86-video-rpifb authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef RPI_TRACE_H
+#define RPI_TRACE_H
+
+#include <stdio.h>
+#include <inttypes.h>
+
+/*
+ * A compact binary trace of the operations hooked in rpi_x.c, which can
+ * be replayed against a memory-backed framebuffer by rpifb-replay.
+ *
+ * The file starts with an rpi_trace_header_t, followed by records. Each
+ * record is an rpi_trace_record_t followed by nbox rpi_trace_box_t. All
+ * values are in host byte order.
+ *
+ * The boxes are the destination rectangles actually handed to the blt2d
+ * functions (after clipping), in the pixel coordinates of the destination
+ * buffer. For copies and images, the source rectangle of a box is the box
+ * translated by (dx, dy), in the pixel coordinates of the source buffer.
+ */
+
+#define RPI_TRACE_MAGIC   0x54495052 /* "RPIT" */
+#define RPI_TRACE_VERSION 1
+
+/* The kind of memory of the source and destination */
+enum {
+    RPI_TRACE_KIND_NONE,        /* no source (fills) */
+    RPI_TRACE_KIND_FRAMEBUFFER, /* the screen pixmap */
+    RPI_TRACE_KIND_PIXMAP,      /* an offscreen pixmap */
+    RPI_TRACE_KIND_IMAGE        /* image data sent by the client */
+};
+
+#define RPI_TRACE_FLAG_REVERSE    1
+#define RPI_TRACE_FLAG_UPSIDEDOWN 2
+#define RPI_TRACE_FLAG_HASH       4 /* the hash field is valid */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint16_t width;     /* the screen */
+    uint16_t height;
+    uint16_t bpp;
+    uint16_t reserved;
+} rpi_trace_header_t;
+
+typedef struct {
+    uint8_t  op;        /* RPI_STATS_OP_* */
+    uint8_t  bpp;
+    uint8_t  src_kind;
+    uint8_t  dst_kind;
+    uint8_t  flags;
+    uint8_t  reserved;
+    uint16_t nbox;
+    int16_t  dx, dy;
+    uint16_t src_width; /* the size of the source pixmap or image */
+    uint16_t src_height;
+    uint32_t color;     /* the fill color */
+    uint32_t hash;      /* FNV-1a hash of the image data */
+} rpi_trace_record_t;
+
+typedef struct {
+    int16_t x1, y1, x2, y2;
+} rpi_trace_box_t;
+
+typedef struct {
+    FILE               *file;
+    int                 hash_images;
+    int                 failed;     /* a write failed, nothing is written */
+    rpi_trace_record_t  record;
+    rpi_trace_box_t    *boxes;
+    int                 boxes_size;
+} rpi_trace_t;
+
+rpi_trace_t *rpi_trace_open(const char *filename, int width, int height,
+                            int bpp, int hash_images);
+/* Returns 0 if the trace couldn't be written in full */
+int rpi_trace_close(rpi_trace_t *trace);
+
+/* Start a new record, the boxes are added with rpi_trace_add_box */
+void rpi_trace_begin(rpi_trace_t *trace, int op, int bpp, int src_kind,
+                     int dst_kind, int flags, int dx, int dy,
+                     int src_width, int src_height, uint32_t color);
+void rpi_trace_add_box(rpi_trace_t *trace, int x1, int y1, int x2, int y2);
+
+/*
+ * Write the record. Returns 0 once a write has failed (on a full disk for
+ * example), the trace should be closed then. Its last record may be cut
+ * short, which rpifb-replay reports as a truncated trace.
+ */
+int rpi_trace_end(rpi_trace_t *trace);
+
+uint32_t rpi_trace_hash(const void *data, size_t size);
+
+/* Only trace if tracing is enabled */
+#define RPI_TRACE_ADD_BOX(trace, x1, y1, x2, y2) \
+    do { \
+        if (trace) \
+            rpi_trace_add_box(trace, x1, y1, x2, y2); \
+    } while (0)
+
+#endif
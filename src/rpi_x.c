@@ -28,6 +28,7 @@
 #include "config.h"
 #endif
 
+#include <limits.h>
 #include <pixman.h>
 
 #include "xorgVersion.h"
@@ -37,9 +38,19 @@
 #include "dri2.h"
 #include "damage.h"
 #include "fb.h"
+#include "opaque.h"
 
 #include "fbdev_priv.h"
 #include "rpi_x.h"
+#include "rpi_stats.h"
+#include "rpi_trace.h"
+#include "rpi_latency.h"
+#include "rpi_adapt.h"
+#include "small_blt.h"
+#include "zero_line.h"
+#include "fill_arc.h"
+#include "fill_pattern.h"
+#include "miline.h"
 
 /*
  * If USE_STANDARD_BLT is defined, use the standard_blt function from the
@@ -49,6 +60,209 @@
 
 /* #define USE_STANDARD_BLT */
 
+/*
+ * Helpers for the trace recorder, which needs to know whether a drawable
+ * lives in the framebuffer or in an offscreen pixmap. The boxes are
+ * recorded in the coordinates of the destination buffer (translated by
+ * xoff, yoff) and dx, dy is the offset to the source buffer coordinates.
+ */
+
+static PixmapPtr
+xGetDrawablePixmap(DrawablePtr pDrawable)
+{
+    if (pDrawable->type == DRAWABLE_WINDOW)
+        return fbGetWindowPixmap((WindowPtr)pDrawable);
+    return (PixmapPtr)pDrawable;
+}
+
+static Bool
+xIsScreenPixmap(DrawablePtr pDrawable)
+{
+    ScreenPtr pScreen = pDrawable->pScreen;
+    return xGetDrawablePixmap(pDrawable) == pScreen->GetScreenPixmap(pScreen);
+}
+
+static int
+xTraceKind(DrawablePtr pDrawable)
+{
+    if (xIsScreenPixmap(pDrawable))
+        return RPI_TRACE_KIND_FRAMEBUFFER;
+    return RPI_TRACE_KIND_PIXMAP;
+}
+
+/*
+ * Write the record of the current operation. When the trace can't be
+ * written any more (the disk is full), tracing stops.
+ */
+static void
+xTraceEnd(ScrnInfoPtr pScrn)
+{
+    RPIAccel *private = RPI_ACCEL(pScrn);
+
+    if (rpi_trace_end(private->trace))
+        return;
+    xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+               "failed to write the trace file, tracing stopped\n");
+    rpi_trace_close(private->trace);
+    private->trace = NULL;
+}
+
+static void
+xTraceCopy(ScrnInfoPtr pScrn, int op,
+           DrawablePtr pSrcDrawable, DrawablePtr pDstDrawable, int bpp,
+           BoxPtr pbox, int nbox, int xoff, int yoff, int dx, int dy,
+           Bool reverse, Bool upsidedown)
+{
+    rpi_trace_t *trace = RPI_ACCEL(pScrn)->trace;
+    PixmapPtr pSrcPixmap = xGetDrawablePixmap(pSrcDrawable);
+    int flags = (reverse ? RPI_TRACE_FLAG_REVERSE : 0) |
+                (upsidedown ? RPI_TRACE_FLAG_UPSIDEDOWN : 0);
+
+    rpi_trace_begin(trace, op, bpp, xTraceKind(pSrcDrawable),
+                    xTraceKind(pDstDrawable), flags, dx, dy,
+                    pSrcPixmap->drawable.width, pSrcPixmap->drawable.height, 0);
+    while (nbox--) {
+        rpi_trace_add_box(trace, pbox->x1 + xoff, pbox->y1 + yoff,
+                          pbox->x2 + xoff, pbox->y2 + yoff);
+        pbox++;
+    }
+    xTraceEnd(pScrn);
+}
+
+/*
+ * The dispatch table of the copies. Which of the accel and CPU backend
+ * stages may take a box only depends on the bpp, the fbBlt direction
+ * flags, whether the source and the destination are the screen pixmap or
+ * offscreen pixmaps, whether they are the same pixmap, and the width
+ * class. So the overlapped_blt_route
+ * hints of the backends are asked once per key, and the boxes go straight
+ * to the stages which may take them.
+ */
+
+static uint8_t *
+xCopyRoute(RPIAccel *private, DrawablePtr pSrcDrawable,
+           DrawablePtr pDstDrawable, int bpp, Bool reverse, Bool upsidedown)
+{
+    return private->copy_route[rpi_stats_bpp_index(bpp)]
+                              [(reverse ? 2 : 0) + (upsidedown ? 1 : 0)]
+                              [xIsScreenPixmap(pSrcDrawable)]
+                              [xIsScreenPixmap(pDstDrawable)]
+                              [xGetDrawablePixmap(pSrcDrawable) ==
+                               xGetDrawablePixmap(pDstDrawable)];
+}
+
+static int
+xCopyRouteStages(RPIAccel *private, FbBits *src, FbBits *dst,
+                 FbStride srcStride, FbStride dstStride, int srcBpp,
+                 int dstBpp, Bool reverse, Bool upsidedown, int width_class)
+{
+    int min_w = 1 << width_class;
+    int max_w = width_class == RPI_ROUTE_NUM_WIDTH_CLASSES - 1 ?
+                INT_MAX : 2 << width_class;
+    int stages = RPI_ROUTE_KNOWN;
+    int route = BLT2D_ROUTE_MAYBE;
+
+    /* The tiny boxes don't need to pay for the function pointer chain */
+    if (srcBpp == dstBpp && small_blt_width_class_ok(dstBpp, width_class))
+        return RPI_ROUTE_KNOWN | RPI_ROUTE_SMALL;
+
+    if (private->blt2d_overlapped_blt_route)
+        route = private->blt2d_overlapped_blt_route(private->blt2d_self,
+                    (uint32_t *)src, (uint32_t *)dst, srcStride, dstStride,
+                    srcBpp, dstBpp, reverse, upsidedown, min_w, max_w);
+    if (route != BLT2D_ROUTE_NEVER)
+        stages |= RPI_ROUTE_ACCEL;
+    if (route == BLT2D_ROUTE_ALWAYS || private->blt2d_cpu_backend == NULL)
+        return stages;
+
+    route = BLT2D_ROUTE_MAYBE;
+    if (private->blt2d_cpu_backend->overlapped_blt_route)
+        route = private->blt2d_cpu_backend->overlapped_blt_route(
+                    private->blt2d_cpu_backend->self,
+                    (uint32_t *)src, (uint32_t *)dst, srcStride, dstStride,
+                    srcBpp, dstBpp, reverse, upsidedown, min_w, max_w);
+    if (route != BLT2D_ROUTE_NEVER)
+        stages |= RPI_ROUTE_CPU_BACKEND;
+    return stages;
+}
+
+static int
+xCopyBoxStages(RPIAccel *private, uint8_t *route, FbBits *src, FbBits *dst,
+               FbStride srcStride, FbStride dstStride, int srcBpp,
+               int dstBpp, Bool reverse, Bool upsidedown, int w)
+{
+    int width_class = rpi_adapt_width_class(w);
+    if (!route[width_class])
+        route[width_class] = xCopyRouteStages(private, src, dst, srcStride,
+                                              dstStride, srcBpp, dstBpp,
+                                              reverse, upsidedown,
+                                              width_class);
+    return route[width_class];
+}
+
+/*
+ * Hand the leading boxes to the box list functions of the stages in the
+ * dispatch table, for as long as one of them takes them. Returns the
+ * number of boxes done, and in *stages the stages which are left to try
+ * one by one for the next box. Not used with the adaptive thresholds,
+ * which time each box separately.
+ */
+static int
+xCopyBoxesBatched(RPIAccel *private, int op, uint8_t *route, BoxPtr pbox,
+                  int nbox, FbBits *src, FbBits *dst, FbStride srcStride,
+                  FbStride dstStride, int srcBpp, int dstBpp, int srcDx,
+                  int srcDy, int dstDx, int dstDy, Bool reverse,
+                  Bool upsidedown, int *stages)
+{
+    blt2d_i *cpu_backend = private->blt2d_cpu_backend;
+    int done = 0;
+
+    while (done < nbox) {
+        const blt2d_box_t *boxes = (const blt2d_box_t *)(pbox + done);
+        int stage = RPI_STATS_STAGE_ACCEL;
+        int n = 0;
+        int i;
+
+        *stages = xCopyBoxStages(private, route, src, dst, srcStride,
+                                 dstStride, srcBpp, dstBpp, reverse,
+                                 upsidedown, boxes->x2 - boxes->x1);
+        if (private->adapt || (*stages & RPI_ROUTE_SMALL))
+            break;
+        if (*stages & RPI_ROUTE_ACCEL) {
+            if (!private->blt2d_overlapped_blt_boxes)
+                break;
+            n = private->blt2d_overlapped_blt_boxes(private->blt2d_self,
+                    (uint32_t *)src, (uint32_t *)dst, srcStride, dstStride,
+                    srcBpp, dstBpp, boxes, nbox - done,
+                    srcDx, srcDy, dstDx, dstDy);
+            if (n == 0)
+                *stages &= ~RPI_ROUTE_ACCEL;
+        }
+        if (n == 0 && (*stages & RPI_ROUTE_CPU_BACKEND)) {
+            if (!cpu_backend->overlapped_blt_boxes)
+                break;
+            stage = RPI_STATS_STAGE_CPU_BACKEND;
+            n = cpu_backend->overlapped_blt_boxes(cpu_backend->self,
+                    (uint32_t *)src, (uint32_t *)dst, srcStride, dstStride,
+                    srcBpp, dstBpp, boxes, nbox - done,
+                    srcDx, srcDy, dstDx, dstDy);
+            if (n == 0)
+                *stages &= ~RPI_ROUTE_CPU_BACKEND;
+        }
+        if (n == 0)
+            break;
+
+        if (private->stats) {
+            for (i = 0; i < n; i++)
+                rpi_stats_count(private->stats, op, stage,
+                                boxes[i].x2 - boxes[i].x1,
+                                boxes[i].y2 - boxes[i].y1, dstBpp);
+        }
+        done += n;
+    }
+    return done;
+}
+
 /*
  * The code below is borrowed from "xserver/fb/fbwindow.c"
  */
@@ -74,25 +288,59 @@ xCopyWindowProc(DrawablePtr pSrcDrawable,
     ScreenPtr pScreen = pDstDrawable->pScreen;
     ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
     RPIAccel *private = RPI_ACCEL(pScrn);
+    uint8_t *route;
 
     fbGetDrawable(pSrcDrawable, src, srcStride, srcBpp, srcXoff, srcYoff);
     fbGetDrawable(pDstDrawable, dst, dstStride, dstBpp, dstXoff, dstYoff);
 
-    while (nbox--) {
-        int w = pbox->x2 - pbox->x1;
-        int h = pbox->y2 - pbox->y1;
-        Bool done;
-        done = private->blt2d_overlapped_blt(private->blt2d_self,
+    if (private->trace)
+        xTraceCopy(pScrn, RPI_STATS_OP_COPY_WINDOW,
+                   pSrcDrawable, pDstDrawable, dstBpp, pbox, nbox, dstXoff,
+                   dstYoff, dx + srcXoff - dstXoff, dy + srcYoff - dstYoff,
+                   reverse, upsidedown);
+
+    route = xCopyRoute(private, pSrcDrawable, pDstDrawable, dstBpp,
+                       reverse, upsidedown);
+
+    while (nbox > 0) {
+        int w, h;
+        Bool done = FALSE;
+        int stage = RPI_STATS_STAGE_FB;
+        int stages;
+        int n = xCopyBoxesBatched(private, RPI_STATS_OP_COPY_WINDOW, route,
+                                  pbox, nbox, src, dst, srcStride, dstStride,
+                                  srcBpp, dstBpp, dx + srcXoff, dy + srcYoff,
+                                  dstXoff, dstYoff, reverse, upsidedown,
+                                  &stages);
+        pbox += n;
+        nbox -= n;
+        if (nbox == 0)
+            break;
+        w = pbox->x2 - pbox->x1;
+        h = pbox->y2 - pbox->y1;
+        RPI_ADAPT_BEGIN(private->adapt);
+        if (stages & RPI_ROUTE_SMALL) {
+            stage = RPI_STATS_STAGE_SMALL;
+            done = small_blt((uint32_t *)src, (uint32_t *)dst,
+                             srcStride, dstStride, dstBpp,
+                             (pbox->x1 + dx + srcXoff), (pbox->y1 + dy + srcYoff),
+                             (pbox->x1 + dstXoff), (pbox->y1 + dstYoff),
+                             w, h, upsidedown);
+        }
+        if (!done && (stages & RPI_ROUTE_ACCEL)) {
+            stage = RPI_STATS_STAGE_ACCEL;
+            done = private->blt2d_overlapped_blt(private->blt2d_self,
                                            (uint32_t *)src, (uint32_t *)dst,
                                            srcStride, dstStride,
                                            srcBpp, dstBpp, (pbox->x1 + dx + srcXoff),
                                            (pbox->y1 + dy + srcYoff), (pbox->x1 + dstXoff),
                                            (pbox->y1 + dstYoff), w,
                                            h);
+        }
         /* When using acceleration, try the ARM CPU back end as fallback. */
-        if (!done) {
-            if (private->blt2d_cpu_backend != NULL)
-                done = private->blt2d_cpu_backend->overlapped_blt(
+        if (!done && (stages & RPI_ROUTE_CPU_BACKEND)) {
+            stage = RPI_STATS_STAGE_CPU_BACKEND;
+            done = private->blt2d_cpu_backend->overlapped_blt(
                              private->blt2d_cpu_backend->self,
                              (uint32_t *)src, (uint32_t *)dst,
                              srcStride, dstStride,
@@ -100,9 +348,11 @@ xCopyWindowProc(DrawablePtr pSrcDrawable,
                              (pbox->y1 + dy + srcYoff), (pbox->x1 + dstXoff),
                              (pbox->y1 + dstYoff), w,
                              h);
-            if (!done)
-                /* fallback to fbBlt */
-                fbBlt(src + (pbox->y1 + dy + srcYoff) * srcStride,
+        }
+        if (!done) {
+            /* fallback to fbBlt */
+            stage = RPI_STATS_STAGE_FB;
+            fbBlt(src + (pbox->y1 + dy + srcYoff) * srcStride,
                   srcStride,
                   (pbox->x1 + dx + srcXoff) * srcBpp,
                   dst + (pbox->y1 + dstYoff) * dstStride,
@@ -112,7 +362,11 @@ xCopyWindowProc(DrawablePtr pSrcDrawable,
                   h,
                   GXcopy, FB_ALLONES, dstBpp, reverse, upsidedown);
         }
+        RPI_ADAPT_END(private->adapt, w, h);
+        RPI_STATS_COUNT(private->stats, RPI_STATS_OP_COPY_WINDOW, stage,
+                        w, h, dstBpp);
         pbox++;
+        nbox--;
     }
 
     fbFinishAccess(pDstDrawable);
@@ -150,6 +404,46 @@ xCopyWindow(WindowPtr pWin, DDXPointRec ptOldOrg, RegionPtr prgnSrc)
 
 /*****************************************************************************/
 
+/*
+ * Read boxes from the framebuffer into another buffer with the
+ * readback_blt functions, in the same order as the other stages. Returns
+ * the number of leading boxes done, the rest go through the usual chain.
+ */
+static int
+xReadbackBoxes(RPIAccel *private, int op, BoxPtr pbox, int nbox,
+               FbBits *src, FbBits *dst, FbStride srcStride,
+               FbStride dstStride, int bpp, int src_dx, int src_dy,
+               int dst_dx, int dst_dy)
+{
+    blt2d_i *cpu_backend = private->blt2d_cpu_backend;
+    int done;
+
+    for (done = 0; done < nbox; done++, pbox++) {
+        int w = pbox->x2 - pbox->x1;
+        int h = pbox->y2 - pbox->y1;
+        int stage = RPI_STATS_STAGE_ACCEL;
+        Bool ok = FALSE;
+        if (private->blt2d_readback_blt)
+            ok = private->blt2d_readback_blt(private->blt2d_self,
+                         (uint32_t *)src, (uint32_t *)dst, srcStride,
+                         dstStride, bpp, pbox->x1 + src_dx,
+                         pbox->y1 + src_dy, pbox->x1 + dst_dx,
+                         pbox->y1 + dst_dy, w, h);
+        if (!ok && cpu_backend && cpu_backend->readback_blt) {
+            stage = RPI_STATS_STAGE_CPU_BACKEND;
+            ok = cpu_backend->readback_blt(cpu_backend->self,
+                         (uint32_t *)src, (uint32_t *)dst, srcStride,
+                         dstStride, bpp, pbox->x1 + src_dx,
+                         pbox->y1 + src_dy, pbox->x1 + dst_dx,
+                         pbox->y1 + dst_dy, w, h);
+        }
+        if (!ok)
+            break;
+        RPI_STATS_COUNT(private->stats, op, stage, w, h, bpp);
+    }
+    return done;
+}
+
 static void
 xCopyNtoN(DrawablePtr pSrcDrawable,
           DrawablePtr pDstDrawable,
@@ -172,6 +466,7 @@ xCopyNtoN(DrawablePtr pSrcDrawable,
     ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
     RPIAccel *private = RPI_ACCEL(pScrn);
     Bool try_pixman, try_standard_blt;
+    uint8_t *route;
 
     fbGetDrawable(pSrcDrawable, src, srcStride, srcBpp, srcXoff, srcYoff);
     fbGetDrawable(pDstDrawable, dst, dstStride, dstBpp, dstXoff, dstYoff);
@@ -188,7 +483,26 @@ xCopyNtoN(DrawablePtr pSrcDrawable,
         try_pixman = FALSE;
 #endif
 
-    while (nbox--) {
+    if (private->trace)
+        xTraceCopy(pScrn, RPI_STATS_OP_COPY_AREA,
+                   pSrcDrawable, pDstDrawable, dstBpp, pbox, nbox, dstXoff,
+                   dstYoff, dx + srcXoff - dstXoff, dy + srcYoff - dstYoff,
+                   reverse, upsidedown);
+
+    route = xCopyRoute(private, pSrcDrawable, pDstDrawable, dstBpp,
+                       reverse, upsidedown);
+
+    /* The copies from windows to pixmaps read the framebuffer */
+    if (srcBpp == dstBpp && xIsScreenPixmap(pSrcDrawable) &&
+        !xIsScreenPixmap(pDstDrawable)) {
+        int n = xReadbackBoxes(private, RPI_STATS_OP_COPY_AREA, pbox, nbox,
+                               src, dst, srcStride, dstStride, dstBpp,
+                               dx + srcXoff, dy + srcYoff, dstXoff, dstYoff);
+        pbox += n;
+        nbox -= n;
+    }
+
+    while (nbox > 0) {
         /*
          * The following scenarios exist regarding accelerated blits:
          * 1. Use hardware blit and the ARM CPU back-end as fall back.
@@ -201,10 +515,33 @@ xCopyNtoN(DrawablePtr pSrcDrawable,
          *    private->blt2d_overlapped_blt is the ARM CPU back-end blit function.
          *    private->blt2d_cpu_back_end is NULL.
          */
-        int w = pbox->x2 - pbox->x1;
-        int h = pbox->y2 - pbox->y1;
-        Bool done;
-        done = private->blt2d_overlapped_blt(
+        int w, h;
+        Bool done = FALSE;
+        int stage = RPI_STATS_STAGE_FB;
+        int stages;
+        int n = xCopyBoxesBatched(private, RPI_STATS_OP_COPY_AREA, route,
+                                  pbox, nbox, src, dst, srcStride, dstStride,
+                                  srcBpp, dstBpp, dx + srcXoff, dy + srcYoff,
+                                  dstXoff, dstYoff, reverse, upsidedown,
+                                  &stages);
+        pbox += n;
+        nbox -= n;
+        if (nbox == 0)
+            break;
+        w = pbox->x2 - pbox->x1;
+        h = pbox->y2 - pbox->y1;
+        RPI_ADAPT_BEGIN(private->adapt);
+        if (stages & RPI_ROUTE_SMALL) {
+            stage = RPI_STATS_STAGE_SMALL;
+            done = small_blt((uint32_t *)src, (uint32_t *)dst,
+                             srcStride, dstStride, dstBpp,
+                             (pbox->x1 + dx + srcXoff), (pbox->y1 + dy + srcYoff),
+                             (pbox->x1 + dstXoff), (pbox->y1 + dstYoff),
+                             w, h, upsidedown);
+        }
+        if (!done && (stages & RPI_ROUTE_ACCEL)) {
+            stage = RPI_STATS_STAGE_ACCEL;
+            done = private->blt2d_overlapped_blt(
                              private->blt2d_self,
                              (uint32_t *)src, (uint32_t *)dst,
                              srcStride, dstStride,
@@ -212,10 +549,11 @@ xCopyNtoN(DrawablePtr pSrcDrawable,
                              (pbox->y1 + dy + srcYoff), (pbox->x1 + dstXoff),
                              (pbox->y1 + dstYoff), w,
                              h);
-        if (!done) {
+        }
+        if (!done && (stages & RPI_ROUTE_CPU_BACKEND)) {
             /* When using acceleration, try the ARM CPU back end as fallback. */
-            if (private->blt2d_cpu_backend != NULL)
-                done = private->blt2d_cpu_backend->overlapped_blt(
+            stage = RPI_STATS_STAGE_CPU_BACKEND;
+            done = private->blt2d_cpu_backend->overlapped_blt(
                              private->blt2d_cpu_backend->self,
                              (uint32_t *)src, (uint32_t *)dst,
                              srcStride, dstStride,
@@ -223,41 +561,126 @@ xCopyNtoN(DrawablePtr pSrcDrawable,
                              (pbox->y1 + dy + srcYoff), (pbox->x1 + dstXoff),
                              (pbox->y1 + dstYoff), w,
                              h);
-
-            if (!done) {
-                /* then standard_blt or pixman */
+        }
+        if (!done) {
+            /* then standard_blt or pixman */
 #ifdef USE_STANDARD_BLT
-                if (try_standard_blt)
-                    done = private->blt2d_standard_blt(
-                        private->blt2d_self,
-                        (uint32_t *)src, (uint32_t *)dst, srcStride, dstStride,
-                        srcBpp, dstBpp, (pbox->x1 + dx + srcXoff),
-                        (pbox->y1 + dy + srcYoff), (pbox->x1 + dstXoff),
-                        (pbox->y1 + dstYoff), w,
-                        h);
+            stage = RPI_STATS_STAGE_STANDARD_BLT;
+            if (try_standard_blt)
+                done = private->blt2d_standard_blt(
+                    private->blt2d_self,
+                    (uint32_t *)src, (uint32_t *)dst, srcStride, dstStride,
+                    srcBpp, dstBpp, (pbox->x1 + dx + srcXoff),
+                    (pbox->y1 + dy + srcYoff), (pbox->x1 + dstXoff),
+                    (pbox->y1 + dstYoff), w,
+                    h);
 #else
-                if (try_pixman)
-                    done = pixman_blt((uint32_t *)src, (uint32_t *)dst, srcStride, dstStride,
-                        srcBpp, dstBpp, (pbox->x1 + dx + srcXoff),
-                        (pbox->y1 + dy + srcYoff), (pbox->x1 + dstXoff),
-                        (pbox->y1 + dstYoff), w,
-                        h);
+            stage = RPI_STATS_STAGE_PIXMAN;
+            if (try_pixman)
+                done = pixman_blt((uint32_t *)src, (uint32_t *)dst, srcStride, dstStride,
+                    srcBpp, dstBpp, (pbox->x1 + dx + srcXoff),
+                    (pbox->y1 + dy + srcYoff), (pbox->x1 + dstXoff),
+                    (pbox->y1 + dstYoff), w,
+                    h);
 #endif
 
-                /* fallback to fbBlt if other methods did not work */
-                if (!done)
-                    // Due to the check in xCopyArea, it is guaranteed that pGC->alu == GXcopy
-                    // and the planemask is FB_ALLONES.
-                    fbBlt(src + (pbox->y1 + dy + srcYoff) * srcStride,
-                        srcStride,
-                        (pbox->x1 + dx + srcXoff) * srcBpp,
-                        dst + (pbox->y1 + dstYoff) * dstStride,
-                        dstStride,
-                        (pbox->x1 + dstXoff) * dstBpp,
-                        w * dstBpp,
-                        h, GXcopy, FB_ALLONES, dstBpp, reverse, upsidedown);
+            /* fallback to fbBlt if other methods did not work */
+            if (!done) {
+                // Due to the check in xCopyArea, it is guaranteed that pGC->alu == GXcopy
+                // and the planemask is FB_ALLONES.
+                stage = RPI_STATS_STAGE_FB;
+                fbBlt(src + (pbox->y1 + dy + srcYoff) * srcStride,
+                    srcStride,
+                    (pbox->x1 + dx + srcXoff) * srcBpp,
+                    dst + (pbox->y1 + dstYoff) * dstStride,
+                    dstStride,
+                    (pbox->x1 + dstXoff) * dstBpp,
+                    w * dstBpp,
+                    h, GXcopy, FB_ALLONES, dstBpp, reverse, upsidedown);
             }
         }
+        RPI_ADAPT_END(private->adapt, w, h);
+        RPI_STATS_COUNT(private->stats, RPI_STATS_OP_COPY_AREA, stage,
+                        w, h, dstBpp);
+        pbox++;
+        nbox--;
+    }
+
+    fbFinishAccess(pDstDrawable);
+    fbFinishAccess(pSrcDrawable);
+}
+
+/*
+ * The copy procedure for the other raster operations and planemasks. The
+ * blt2d_i implementations which have a rop_blt do the work, with fbBlt as
+ * the fallback. These copies are not traced, the trace format can't
+ * describe them.
+ */
+static void
+xCopyNtoNRop(DrawablePtr pSrcDrawable,
+             DrawablePtr pDstDrawable,
+             GCPtr pGC,
+             BoxPtr pbox,
+             int nbox,
+             int dx,
+             int dy,
+             Bool reverse, Bool upsidedown, Pixel bitplane, void *closure)
+{
+    FbBits *src;
+    FbStride srcStride;
+    int srcBpp;
+    int srcXoff, srcYoff;
+    FbBits *dst;
+    FbStride dstStride;
+    int dstBpp;
+    int dstXoff, dstYoff;
+    ScreenPtr pScreen = pDstDrawable->pScreen;
+    ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+    RPIAccel *private = RPI_ACCEL(pScrn);
+    blt2d_i *cpu_backend = private->blt2d_cpu_backend;
+    int alu = pGC->alu;
+    FbBits pm = fbGetGCPrivate(pGC)->pm;
+
+    fbGetDrawable(pSrcDrawable, src, srcStride, srcBpp, srcXoff, srcYoff);
+    fbGetDrawable(pDstDrawable, dst, dstStride, dstBpp, dstXoff, dstYoff);
+
+    while (nbox--) {
+        int w = pbox->x2 - pbox->x1;
+        int h = pbox->y2 - pbox->y1;
+        Bool done = FALSE;
+        int stage = RPI_STATS_STAGE_ACCEL;
+
+        if (private->blt2d_rop_blt)
+            done = private->blt2d_rop_blt(
+                             private->blt2d_self,
+                             (uint32_t *)src, (uint32_t *)dst,
+                             srcStride, dstStride,
+                             srcBpp, dstBpp, (pbox->x1 + dx + srcXoff),
+                             (pbox->y1 + dy + srcYoff), (pbox->x1 + dstXoff),
+                             (pbox->y1 + dstYoff), w, h, alu, pm);
+        if (!done && cpu_backend && cpu_backend->rop_blt) {
+            stage = RPI_STATS_STAGE_CPU_BACKEND;
+            done = cpu_backend->rop_blt(
+                             cpu_backend->self,
+                             (uint32_t *)src, (uint32_t *)dst,
+                             srcStride, dstStride,
+                             srcBpp, dstBpp, (pbox->x1 + dx + srcXoff),
+                             (pbox->y1 + dy + srcYoff), (pbox->x1 + dstXoff),
+                             (pbox->y1 + dstYoff), w, h, alu, pm);
+        }
+        if (!done) {
+            stage = RPI_STATS_STAGE_FB;
+            fbBlt(src + (pbox->y1 + dy + srcYoff) * srcStride,
+                srcStride,
+                (pbox->x1 + dx + srcXoff) * srcBpp,
+                dst + (pbox->y1 + dstYoff) * dstStride,
+                dstStride,
+                (pbox->x1 + dstXoff) * dstBpp,
+                w * dstBpp,
+                h, alu, pm, dstBpp, reverse, upsidedown);
+        }
+        RPI_STATS_COUNT(private->stats, RPI_STATS_OP_COPY_AREA, stage,
+                        w, h, dstBpp);
         pbox++;
     }
 
@@ -274,12 +697,23 @@ xCopyArea(DrawablePtr pSrcDrawable,
     CARD8 alu = pGC ? pGC->alu : GXcopy;
     FbBits pm = pGC ? fbGetGCPrivate(pGC)->pm : FB_ALLONES;
 
-    if (pm == FB_ALLONES && alu == GXcopy && 
-        pSrcDrawable->bitsPerPixel == pDstDrawable->bitsPerPixel &&
-        (pSrcDrawable->bitsPerPixel == 32 || pSrcDrawable->bitsPerPixel == 16))
+    if (pSrcDrawable->bitsPerPixel == pDstDrawable->bitsPerPixel &&
+        (pSrcDrawable->bitsPerPixel == 32 || pSrcDrawable->bitsPerPixel == 24 ||
+         pSrcDrawable->bitsPerPixel == 16 || pSrcDrawable->bitsPerPixel == 8))
     {
-        return miDoCopy(pSrcDrawable, pDstDrawable, pGC, xIn, yIn,
-                    widthSrc, heightSrc, xOut, yOut, xCopyNtoN, 0, 0);
+        ScrnInfoPtr pScrn = xf86Screens[pDstDrawable->pScreen->myNum];
+        RPIAccel *private = RPI_ACCEL(pScrn);
+
+        if (pm == FB_ALLONES && alu == GXcopy)
+            return miDoCopy(pSrcDrawable, pDstDrawable, pGC, xIn, yIn,
+                        widthSrc, heightSrc, xOut, yOut, xCopyNtoN, 0, 0);
+        /* rop_blt doesn't do 24bpp, fb copes with its planemask there */
+        if (pGC && pSrcDrawable->bitsPerPixel != 24 &&
+                   (private->blt2d_rop_blt ||
+                    (private->blt2d_cpu_backend &&
+                     private->blt2d_cpu_backend->rop_blt)))
+            return miDoCopy(pSrcDrawable, pDstDrawable, pGC, xIn, yIn,
+                        widthSrc, heightSrc, xOut, yOut, xCopyNtoNRop, 0, 0);
     }
     return fbCopyArea(pSrcDrawable,
                       pDstDrawable,
@@ -287,6 +721,80 @@ xCopyArea(DrawablePtr pSrcDrawable,
                       xIn, yIn, widthSrc, heightSrc, xOut, yOut);
 }
 
+/*
+ * X regions are y-banded: the boxes are sorted by y1 and then by x1, and
+ * all the boxes of a band have the same y1 and y2. So y2 never decreases
+ * along the box list, and the first box which may intersect the rows from
+ * y downwards is found with a binary search. The clipping loops start
+ * there and stop at the first band below the rectangle.
+ */
+static BoxPtr
+xRegionFirstBox(BoxPtr pbox, int nbox, int y)
+{
+    int lo = 0, hi = nbox;
+    while (lo < hi) {
+        int mid = (lo + hi) >> 1;
+        if (pbox[mid].y2 <= y)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return pbox + lo;
+}
+
+/*
+ * Adapted from fbGetImage, for the ZPixmap images of all the planes of the
+ * screen, which are what screenshots and remote desktops ask for. The
+ * framebuffer is read by the readback_blt functions, the other images are
+ * left to fb.
+ */
+static void
+xGetImage(DrawablePtr pDrawable, int x, int y, int w, int h,
+          unsigned int format, unsigned long planeMask, char *d)
+{
+    ScrnInfoPtr pScrn = xf86Screens[pDrawable->pScreen->myNum];
+    RPIAccel *private = RPI_ACCEL(pScrn);
+    FbBits *src;
+    FbStride srcStride;
+    int srcBpp;
+    int srcXoff, srcYoff;
+    FbStride dstStride;
+    BoxRec box;
+    int bpp = pDrawable->bitsPerPixel;
+
+    if (format != ZPixmap || !fbDrawableEnabled(pDrawable) ||
+        bpp != BitsPerPixel(pDrawable->depth) ||
+        (bpp != 8 && bpp != 16 && bpp != 24 && bpp != 32) ||
+        fbReplicatePixel(planeMask, bpp) != FB_ALLONES ||
+        w <= 0 || h <= 0 || !xIsScreenPixmap(pDrawable)) {
+        fbGetImage(pDrawable, x, y, w, h, format, planeMask, d);
+        return;
+    }
+
+    fbGetDrawable(pDrawable, src, srcStride, srcBpp, srcXoff, srcYoff);
+    dstStride = PixmapBytePad(w, pDrawable->depth) / sizeof(FbBits);
+    box.x1 = x + pDrawable->x + srcXoff;
+    box.y1 = y + pDrawable->y + srcYoff;
+    box.x2 = box.x1 + w;
+    box.y2 = box.y1 + h;
+
+    if (!xReadbackBoxes(private, RPI_STATS_OP_GET_IMAGE, &box, 1, src,
+                        (FbBits *)d, srcStride, dstStride, bpp, 0, 0,
+                        -box.x1, -box.y1)) {
+        int stage = RPI_STATS_STAGE_PIXMAN;
+        if (!pixman_blt((uint32_t *)src, (uint32_t *)d, srcStride, dstStride,
+                        bpp, bpp, box.x1, box.y1, 0, 0, w, h)) {
+            stage = RPI_STATS_STAGE_FB;
+            fbBlt(src + box.y1 * srcStride, srcStride, box.x1 * bpp,
+                  (FbBits *)d, dstStride, 0, w * bpp, h, GXcopy, FB_ALLONES,
+                  bpp, FALSE, FALSE);
+        }
+        RPI_STATS_COUNT(private->stats, RPI_STATS_OP_GET_IMAGE, stage,
+                        w, h, bpp);
+    }
+    fbFinishAccess(pDrawable);
+}
+
 /*
  * The following function is adapted from xserver/fb/fbPutImage.c.
  */
@@ -305,8 +813,7 @@ void xPutImage(DrawablePtr pDrawable,
     FbStride dstStride;
     int dstBpp;
     int dstXoff, dstYoff;
-    int nbox;
-    BoxPtr pbox;
+    BoxPtr pbox, pboxEnd;
     int x1, y1, x2, y2;
 
     if (format == XYBitmap || format == XYPixmap ||
@@ -335,8 +842,22 @@ void xPutImage(DrawablePtr pDrawable,
 
     fbGetStipDrawable(pDrawable, dst, dstStride, dstBpp, dstXoff, dstYoff);
 
-    for (nbox = RegionNumRects(pClip),
-        pbox = RegionRects(pClip); nbox--; pbox++) {
+    if (private->trace) {
+        int flags = 0;
+        uint32_t hash = 0;
+        if (private->trace->hash_images) {
+            hash = rpi_trace_hash(pImage, srcStride * sizeof(FbStip) * h);
+            flags = RPI_TRACE_FLAG_HASH;
+        }
+        rpi_trace_begin(private->trace, RPI_STATS_OP_PUT_IMAGE, dstBpp,
+                        RPI_TRACE_KIND_IMAGE, xTraceKind(pDrawable), flags,
+                        -x - dstXoff, -y - dstYoff, w, h, 0);
+        private->trace->record.hash = hash;
+    }
+
+    pboxEnd = RegionRects(pClip) + RegionNumRects(pClip);
+    for (pbox = xRegionFirstBox(RegionRects(pClip), RegionNumRects(pClip), y);
+         pbox < pboxEnd && pbox->y1 < y + h; pbox++) {
         x1 = x;
         y1 = y;
         x2 = x + w;
@@ -351,29 +872,61 @@ void xPutImage(DrawablePtr pDrawable,
             y2 = pbox->y2;
         if (x1 >= x2 || y1 >= y2)
             continue;
+        RPI_TRACE_ADD_BOX(private->trace, x1 + dstXoff, y1 + dstYoff,
+                          x2 + dstXoff, y2 + dstYoff);
         Bool done = FALSE;
         int w = x2 - x1;
         int h = y2 - y1;
-        /* first try pixman (ARM) */
-        if (!done)
+        int stage;
+        /* the tiny boxes are copied inline */
+        stage = RPI_STATS_STAGE_SMALL;
+        done = small_blt((uint32_t *)src, (uint32_t *)dst, srcStride, dstStride,
+                         dstBpp, x1 - x, y1 - y, x1 + dstXoff, y1 + dstYoff,
+                         w, h, FALSE);
+        /* then try pixman (ARM) */
 #ifdef USE_STANDARD_BLT
-            if (private->blt2d_standard_blt != NULL)
-                done = private->blt2d_standard_blt(
+        if (!done && private->blt2d_standard_blt != NULL) {
+            stage = RPI_STATS_STAGE_STANDARD_BLT;
+            done = private->blt2d_standard_blt(
                     private->blt2d_self,
                     (uint32_t *)src, (uint32_t *)dst, srcStride, dstStride,
                     dstBpp, dstBpp, x1 - x,
                     y1 - y, x1 + dstXoff,
                     y1 + dstYoff, w,
                     h);
+        }
 #else
+        if (!done) {
+            stage = RPI_STATS_STAGE_PIXMAN;
             done = pixman_blt((uint32_t *)src, (uint32_t *)dst, srcStride, dstStride,
-                 dstBpp, dstBpp, x1 - x,
-                 y1 - y, x1 + dstXoff,
-                 y1 + dstYoff, w,
-                 h);
+                     dstBpp, dstBpp, x1 - x,
+                     y1 - y, x1 + dstXoff,
+                     y1 + dstYoff, w,
+                     h);
+        }
 #endif
+        /* pixman may not copy 8 and 24bpp pixels, the CPU back end takes them */
+        if (!done && (dstBpp == 8 || dstBpp == 24)) {
+            blt2d_i *cpu_backend = private->blt2d_cpu_backend;
+            stage = RPI_STATS_STAGE_CPU_BACKEND;
+            if (cpu_backend)
+                done = cpu_backend->overlapped_blt(cpu_backend->self,
+                        (uint32_t *)src, (uint32_t *)dst, srcStride, dstStride,
+                        dstBpp, dstBpp, x1 - x,
+                        y1 - y, x1 + dstXoff,
+                        y1 + dstYoff, w,
+                        h);
+            else
+                done = private->blt2d_overlapped_blt(private->blt2d_self,
+                        (uint32_t *)src, (uint32_t *)dst, srcStride, dstStride,
+                        dstBpp, dstBpp, x1 - x,
+                        y1 - y, x1 + dstXoff,
+                        y1 + dstYoff, w,
+                        h);
+        }
         // otherwise fall back to fb */
-        if (!done)
+        if (!done) {
+            stage = RPI_STATS_STAGE_FB;
             fbBlt(src + (y1 - y) * srcStride,
                   srcStride,
                   (x1 - x) * dstBpp,
@@ -382,10 +935,243 @@ void xPutImage(DrawablePtr pDrawable,
                   (x1 + dstXoff) * dstBpp,
                   w * dstBpp,
                   h, GXcopy, FB_ALLONES, dstBpp, FALSE, FALSE);
+        }
+        RPI_STATS_COUNT(private->stats, RPI_STATS_OP_PUT_IMAGE, stage,
+                        w, h, dstBpp);
     }
+    if (private->trace)
+        xTraceEnd(pScrn);
     fbFinishAccess(pDrawable);
 }
 
+/*
+ * The clipped fragments of the solid fills are gathered and submitted in
+ * batches of up to RPI_FILL_BATCH_SIZE boxes to the fill_boxes functions,
+ * which can sort and merge them.
+ */
+#define RPI_FILL_BATCH_SIZE 64
+
+/* The per-box fallback chain of the solid fills, counted as op */
+static void
+xFillBox(RPIAccel *private, int op, FbBits *dst, int dstStride, int dstBpp,
+         int x, int y, int w, int h, FbBits and, FbBits xor,
+         Bool try_blt2d_fill, Bool try_pixman_fill)
+{
+    Bool done = FALSE;
+    int stage = RPI_STATS_STAGE_ACCEL;
+    if (try_blt2d_fill)
+        done = private->blt2d_fill(private->blt2d_self, (uint32_t *)dst, dstStride, dstBpp, x, y, w, h, xor);
+    if (!done) {
+        stage = RPI_STATS_STAGE_PIXMAN;
+        if (try_pixman_fill)
+            done = pixman_fill((uint32_t *)dst, dstStride, dstBpp, x, y, w, h, xor);
+        if (!done) {
+            stage = RPI_STATS_STAGE_FB;
+            fbSolid(dst + y * dstStride, dstStride, x * dstBpp, dstBpp, w * dstBpp, h, and, xor);
+        }
+    }
+    RPI_STATS_COUNT(private->stats, op, stage, w, h, dstBpp);
+}
+
+/*
+ * Submit a batch of boxes, in the pixel coordinates of the destination
+ * buffer, to the fill_boxes functions of the accel and CPU backend stages.
+ * The boxes they decline go through xFillBox.
+ */
+static void
+xFillBoxes(RPIAccel *private, int op, FbBits *dst, int dstStride, int dstBpp,
+           const blt2d_box_t *boxes, int nbox, FbBits and, FbBits xor,
+           Bool try_blt2d_fill, Bool try_pixman_fill)
+{
+    blt2d_i *cpu_backend = private->blt2d_cpu_backend;
+
+    while (nbox > 0) {
+        int stage = RPI_STATS_STAGE_ACCEL;
+        int n = 0;
+        int i;
+
+        if (private->blt2d_fill_boxes)
+            n = private->blt2d_fill_boxes(private->blt2d_self,
+                                          (uint32_t *)dst, dstStride,
+                                          dstBpp, boxes, nbox, 0, 0, xor);
+        if (n == 0 && cpu_backend && cpu_backend->fill_boxes) {
+            stage = RPI_STATS_STAGE_CPU_BACKEND;
+            n = cpu_backend->fill_boxes(cpu_backend->self,
+                                        (uint32_t *)dst, dstStride,
+                                        dstBpp, boxes, nbox, 0, 0, xor);
+        }
+        if (n == 0) {
+            xFillBox(private, op, dst, dstStride, dstBpp, boxes->x1, boxes->y1,
+                     boxes->x2 - boxes->x1, boxes->y2 - boxes->y1,
+                     and, xor, try_blt2d_fill, try_pixman_fill);
+            n = 1;
+        } else if (private->stats) {
+            for (i = 0; i < n; i++)
+                rpi_stats_count(private->stats, op,
+                                stage, boxes[i].x2 - boxes[i].x1,
+                                boxes[i].y2 - boxes[i].y1, dstBpp);
+        }
+        boxes += n;
+        nbox -= n;
+    }
+}
+
+/*
+ * The tiled and stippled fills of xPolyFillRect and the span hooks. The
+ * tile or stipple of the GC is prepared by fill_pattern.h, and the rows of
+ * the boxes and spans are copied from it.
+ */
+
+typedef struct {
+    fill_pattern_t pat;
+    int            x, y;     /* the pattern origin in the destination */
+    DrawablePtr    pTile;    /* the tile used as is, if any */
+} xPatternState;
+
+/*
+ * Whether the tile or stipple of the GC is drawn by the pattern fills:
+ * for GXcopy, with tiles of the bpp of the destination which aren't the
+ * destination itself.
+ */
+static Bool
+xPatternAccepted(DrawablePtr pDrawable, GCPtr pGC)
+{
+    FbGCPrivPtr pPriv = fbGetGCPrivate(pGC);
+    int bpp = pDrawable->bitsPerPixel;
+
+    if (pGC->alu != GXcopy || pPriv->pm != FB_ALLONES ||
+        (bpp != 8 && bpp != 16 && bpp != 24 && bpp != 32))
+        return FALSE;
+    switch (pGC->fillStyle) {
+    case FillTiled:
+        return !pGC->tileIsPixel &&
+               pGC->tile.pixmap->drawable.bitsPerPixel == bpp &&
+               &pGC->tile.pixmap->drawable != pDrawable;
+    case FillStippled:
+    case FillOpaqueStippled:
+        return pGC->stipple != NULL;
+    }
+    return FALSE;
+}
+
+/*
+ * Prepare the pattern of the GC, the destination offsets are those of
+ * fbGetDrawable. Returns FALSE if the stipple is too large to expand.
+ */
+static Bool
+xPatternBegin(xPatternState *pattern, DrawablePtr pDrawable, GCPtr pGC,
+              int dstXoff, int dstYoff)
+{
+    int bpp = pDrawable->bitsPerPixel;
+
+    pattern->x = pGC->patOrg.x + pDrawable->x + dstXoff;
+    pattern->y = pGC->patOrg.y + pDrawable->y + dstYoff;
+    pattern->pTile = NULL;
+
+    if (pGC->fillStyle == FillTiled) {
+        PixmapPtr pTile = pGC->tile.pixmap;
+        FbBits *tile;
+        FbStride tileStride;
+        int tileBpp, tileXoff, tileYoff;
+
+        fbGetDrawable(&pTile->drawable, tile, tileStride, tileBpp, tileXoff,
+                      tileYoff);
+        fill_pattern_init_tile(&pattern->pat,
+                               (uint8_t *)(tile + tileYoff * tileStride) +
+                               tileXoff * (tileBpp >> 3),
+                               tileStride * sizeof(FbBits),
+                               pTile->drawable.width, pTile->drawable.height,
+                               bpp);
+        /* the rows of a wide tile are copied from the tile itself */
+        if (pattern->pat.alloc)
+            fbFinishAccess(&pTile->drawable);
+        else
+            pattern->pTile = &pTile->drawable;
+        return TRUE;
+    } else {
+        PixmapPtr pStipple = pGC->stipple;
+        FbStip *stip;
+        FbStride stipStride;
+        int stipBpp, stipXoff, stipYoff;
+        Bool ret;
+
+        fbGetStipDrawable(&pStipple->drawable, stip, stipStride, stipBpp,
+                          stipXoff, stipYoff);
+        ret = stipXoff == 0 &&
+              fill_pattern_init_stipple(&pattern->pat,
+                                        stip + stipYoff * stipStride,
+                                        stipStride, pStipple->drawable.width,
+                                        pStipple->drawable.height,
+                                        BITMAP_BIT_ORDER == LSBFirst, bpp,
+                                        pGC->fgPixel, pGC->bgPixel,
+                                        pGC->fillStyle == FillOpaqueStippled);
+        fbFinishAccess(&pStipple->drawable);
+        return ret;
+    }
+}
+
+static void
+xPatternEnd(xPatternState *pattern)
+{
+    fill_pattern_fini(&pattern->pat);
+    if (pattern->pTile)
+        fbFinishAccess(pattern->pTile);
+}
+
+/* Copy a batch of boxes, like those of xFillBoxes, from the pattern rows */
+static void
+xPatternBoxes(RPIAccel *private, int op, FbBits *dst, int dstStride,
+              int dstBpp, const blt2d_box_t *boxes, int nbox,
+              const xPatternState *pattern)
+{
+    const fill_pattern_t *pat = &pattern->pat;
+    int Bpp = dstBpp >> 3;
+    intptr_t dstStrideBytes = dstStride * sizeof(FbBits);
+
+    for (; nbox > 0; nbox--, boxes++) {
+        uint8_t *d = (uint8_t *)dst + boxes->y1 * dstStrideBytes +
+                     boxes->x1 * Bpp;
+        int w = boxes->x2 - boxes->x1;
+        int tx = fill_pattern_phase(boxes->x1 - pattern->x, pat->width);
+        int ty = fill_pattern_phase(boxes->y1 - pattern->y, pat->height);
+        int y;
+
+        for (y = boxes->y1; y < boxes->y2; y++) {
+            fill_pattern_row(pat, d, tx, ty, w);
+            d += dstStrideBytes;
+            if (++ty == pat->height)
+                ty = 0;
+        }
+        RPI_STATS_COUNT(private->stats, op, RPI_STATS_STAGE_SPAN, w,
+                        boxes->y2 - boxes->y1, dstBpp);
+    }
+}
+
+/* Submit the batch of xPolyFillRect */
+#define FILL_BATCH_FLUSH() \
+    do { \
+        if (patterned) \
+            xPatternBoxes(private, RPI_STATS_OP_POLY_FILL_RECT, dst, \
+                          dstStride, dstBpp, batch, nbatch, &pattern); \
+        else \
+            xFillBoxes(private, RPI_STATS_OP_POLY_FILL_RECT, dst, dstStride, \
+                       dstBpp, batch, nbatch, pPriv->and, pPriv->xor, \
+                       try_blt2d_fill, try_pixman_fill); \
+        nbatch = 0; \
+    } while (0)
+
+/* Add a box to the batch of xPolyFillRect, submitting it when it's full */
+#define FILL_BATCH_ADD(_x, _y, _w, _h) \
+    do { \
+        if (nbatch == RPI_FILL_BATCH_SIZE) \
+            FILL_BATCH_FLUSH(); \
+        batch[nbatch].x1 = (_x); \
+        batch[nbatch].y1 = (_y); \
+        batch[nbatch].x2 = (_x) + (_w); \
+        batch[nbatch].y2 = (_y) + (_h); \
+        nbatch++; \
+    } while (0)
+
 /* Adapted from fbPolyFillRect and fbFill. */
 
 static void xPolyFillRect(DrawablePtr pDrawable,
@@ -396,7 +1182,7 @@ static void xPolyFillRect(DrawablePtr pDrawable,
     ScreenPtr pScreen;
     ScrnInfoPtr pScrn;
     RegionPtr pClip;
-    BoxPtr pbox;
+    BoxPtr pbox, pboxEnd;
     BoxPtr pextent;
     int extentX1, extentX2, extentY1, extentY2;
     int fullX1, fullX2, fullY1, fullY2;
@@ -412,8 +1198,14 @@ static void xPolyFillRect(DrawablePtr pDrawable,
     pPriv = fbGetGCPrivate(pGC);
     FbBits pm = pPriv->pm;
     Bool try_blt2d_fill, try_pixman_fill;
-
-    if (pGC->fillStyle != FillSolid || pm != FB_ALLONES || pPriv->and) {
+    blt2d_box_t batch[RPI_FILL_BATCH_SIZE];
+    int nbatch = 0;
+    Bool patterned = pGC->fillStyle != FillSolid;
+    xPatternState pattern;
+    rpi_trace_t *trace;
+
+    if (patterned ? !xPatternAccepted(pDrawable, pGC) :
+                    pm != FB_ALLONES || pPriv->and) {
         fbPolyFillRect(pDrawable, pGC, nrect, prect);
         return;
     }
@@ -426,6 +1218,13 @@ static void xPolyFillRect(DrawablePtr pDrawable,
     // Note: dstXoff and dstYoff are generally zero or negative.
     fbGetDrawable(pDrawable, dst, dstStride, dstBpp, dstXoff, dstYoff);
 
+    if (patterned &&
+        !xPatternBegin(&pattern, pDrawable, pGC, dstXoff, dstYoff)) {
+        fbFinishAccess(pDrawable);
+        fbPolyFillRect(pDrawable, pGC, nrect, prect);
+        return;
+    }
+
     xorg = pDrawable->x;
     yorg = pDrawable->y;
 
@@ -441,6 +1240,13 @@ static void xPolyFillRect(DrawablePtr pDrawable,
         try_pixman_fill = FALSE;
     }
 
+    /* the trace records solid fills only */
+    trace = patterned ? NULL : private->trace;
+    if (trace)
+        rpi_trace_begin(trace, RPI_STATS_OP_POLY_FILL_RECT, dstBpp,
+                        RPI_TRACE_KIND_NONE, xTraceKind(pDrawable), 0, 0, 0,
+                        0, 0, pPriv->xor);
+
     pextent = REGION_EXTENTS(pGC->pScreen, pClip);
     extentX1 = pextent->x1;
     extentY1 = pextent->y1;
@@ -471,29 +1277,24 @@ static void xPolyFillRect(DrawablePtr pDrawable,
         n = REGION_NUM_RECTS (pClip);
         if (n == 1)
         {
-            Bool done = FALSE;
             int x ,y, w, h;
             x = fullX1 + dstXoff;
             y = fullY1 + dstYoff;
             w = fullX2 - fullX1;
             h = fullY2 - fullY1;
-            if (try_blt2d_fill)
-                done = private->blt2d_fill(private->blt2d_self, (uint32_t *)dst, dstStride, dstBpp, x, y, w, h, pPriv->xor);
-            if (!done) {
-                if (try_pixman_fill)
-                    done = pixman_fill((uint32_t *)dst, dstStride, dstBpp, x, y, w, h, pPriv->xor);
-                if (!done)
-                    fbSolid(dst + y * dstStride, dstStride, x * dstBpp, dstBpp, w * dstBpp, h, pPriv->and, pPriv->xor);
-            }
+            RPI_TRACE_ADD_BOX(trace, x, y, x + w, y + h);
+            FILL_BATCH_ADD(x, y, w, h);
         }
         else
         {
-            pbox = REGION_RECTS(pClip);
+            pbox = xRegionFirstBox(REGION_RECTS(pClip), n, fullY1);
+            pboxEnd = REGION_RECTS(pClip) + n;
             /*
-             * clip the rectangle to each box in the clip region
+             * clip the rectangle to each box in the bands of the clip
+             * region which it spans
              * this is logically equivalent to calling Intersect()
              */
-            while(n--)
+            while (pbox < pboxEnd && pbox->y1 < fullY2)
             {
                 partX1 = pbox->x1;
                 if (partX1 < fullX1)
@@ -511,48 +1312,952 @@ static void xPolyFillRect(DrawablePtr pDrawable,
                 pbox++;
 
                 if (partX1 < partX2 && partY1 < partY2) {
-                    Bool done = FALSE;
                     int w, h;
                     int x = partX1 + dstXoff;
                     int y = partY1 + dstYoff;
                     w = partX2 - partX1;
                     h = partY2 - partY1;
-                    if (try_blt2d_fill)
-                        done = private->blt2d_fill(private->blt2d_self, (uint32_t *)dst, dstStride, dstBpp, x, y, w, h, pPriv->xor);
-                    if (!done) {
-                        if (try_pixman_fill)
-                            done = pixman_fill((uint32_t *)dst, dstStride, dstBpp, x, y, w, h, pPriv->xor);
-                        if (!done)
-                            fbSolid(dst + y * dstStride, dstStride, x * dstBpp, dstBpp, w * dstBpp, h, pPriv->and, pPriv->xor);
-                    }
+                    RPI_TRACE_ADD_BOX(trace, x, y, x + w, y + h);
+                    FILL_BATCH_ADD(x, y, w, h);
                 }
             }
         }
     }
+    FILL_BATCH_FLUSH();
+    if (patterned)
+        xPatternEnd(&pattern);
+    else if (trace)
+        xTraceEnd(pScrn);
     fbFinishAccess(pDrawable);
 }
 
+/*****************************************************************************/
+
+/*
+ * The zero width solid lines of PolySegment, PolyLine and PolyRectangle.
+ * The horizontal and vertical lines, which make up most of the grids and
+ * charts, are clipped into boxes for the fill chain above. The other ones
+ * are clipped like fbSegment does and drawn by the zero_line.h kernels,
+ * which touch exactly the same pixels as fb.
+ */
+
+typedef struct {
+    RPIAccel     *private;
+    FbBits       *dst;
+    FbStride      dstStride;
+    int           dstBpp;
+    int           dstXoff, dstYoff;
+    BoxPtr        pClipBoxes;
+    int           nClipBoxes;
+    unsigned int  bias;         /* the octants of miGetZeroLineBias */
+    FbBits        and, xor;
+    Bool          try_blt2d_fill, try_pixman_fill;
+    blt2d_box_t   batch[RPI_FILL_BATCH_SIZE];
+    int           nbatch;
+} xLineState;
+
+/* Whether the line hooks draw with this GC, fb or mi do otherwise */
 static Bool
-xCreateGC(GCPtr pGC)
+xLineAccepted(DrawablePtr pDrawable, GCPtr pGC)
 {
-    ScreenPtr pScreen = pGC->pScreen;
-    ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
-    RPIAccel *self = RPI_ACCEL(pScrn);
-    Bool result;
+    FbGCPrivPtr pPriv = fbGetGCPrivate(pGC);
+    int bpp = pDrawable->bitsPerPixel;
 
-    if (!fbCreateGC(pGC))
-        return FALSE;
+    return pGC->lineWidth == 0 && pGC->lineStyle == LineSolid &&
+           pGC->fillStyle == FillSolid && pPriv->pm == FB_ALLONES &&
+           !pPriv->and && (bpp == 8 || bpp == 16 || bpp == 24 || bpp == 32);
+}
 
-    if (!self->pGCOps) {
-        self->pGCOps = calloc(1, sizeof(GCOps));
+static void
+xLineBegin(xLineState *state, DrawablePtr pDrawable, GCPtr pGC)
+{
+    ScrnInfoPtr pScrn = xf86Screens[pDrawable->pScreen->myNum];
+    FbGCPrivPtr pPriv = fbGetGCPrivate(pGC);
+    RegionPtr pClip = fbGetCompositeClip(pGC);
+
+    state->private = RPI_ACCEL(pScrn);
+    fbGetDrawable(pDrawable, state->dst, state->dstStride, state->dstBpp,
+                  state->dstXoff, state->dstYoff);
+    state->pClipBoxes = RegionRects(pClip);
+    state->nClipBoxes = RegionNumRects(pClip);
+    state->bias = miGetZeroLineBias(pDrawable->pScreen);
+    state->and = pPriv->and;
+    state->xor = pPriv->xor;
+    state->try_blt2d_fill = state->private->blt2d_fill != NULL;
+    state->try_pixman_fill = TRUE;
+    state->nbatch = 0;
+}
+
+static void
+xLineFlush(xLineState *state)
+{
+    xFillBoxes(state->private, RPI_STATS_OP_POLY_LINE, state->dst,
+               state->dstStride, state->dstBpp, state->batch, state->nbatch,
+               state->and, state->xor, state->try_blt2d_fill,
+               state->try_pixman_fill);
+    state->nbatch = 0;
+}
+
+static void
+xLineEnd(xLineState *state, DrawablePtr pDrawable)
+{
+    xLineFlush(state);
+    fbFinishAccess(pDrawable);
+}
+
+/* Clip the box x1, y1, x2, y2 (exclusive) and add the pieces to the batch */
+static void
+xLineBox(xLineState *state, int x1, int y1, int x2, int y2)
+{
+    BoxPtr pbox = xRegionFirstBox(state->pClipBoxes, state->nClipBoxes, y1);
+    BoxPtr pboxEnd = state->pClipBoxes + state->nClipBoxes;
+
+    if (x1 >= x2 || y1 >= y2)
+        return;
+
+    for (; pbox < pboxEnd && pbox->y1 < y2; pbox++) {
+        blt2d_box_t *box;
+        int bx1 = x1, by1 = y1, bx2 = x2, by2 = y2;
+        if (bx1 < pbox->x1)
+            bx1 = pbox->x1;
+        if (by1 < pbox->y1)
+            by1 = pbox->y1;
+        if (bx2 > pbox->x2)
+            bx2 = pbox->x2;
+        if (by2 > pbox->y2)
+            by2 = pbox->y2;
+        if (bx1 >= bx2 || by1 >= by2)
+            continue;
+        if (state->nbatch == RPI_FILL_BATCH_SIZE)
+            xLineFlush(state);
+        box = &state->batch[state->nbatch++];
+        box->x1 = bx1 + state->dstXoff;
+        box->y1 = by1 + state->dstYoff;
+        box->x2 = bx2 + state->dstXoff;
+        box->y2 = by2 + state->dstYoff;
+    }
+}
+
+static void
+xLineDraw(xLineState *state, int x, int y, int signdx, int signdy,
+          Bool x_major, int e, int e1, int e3, int len)
+{
+    zero_line((uint32_t *)state->dst, state->dstStride, state->dstBpp,
+              x + state->dstXoff, y + state->dstYoff, signdx, signdy,
+              x_major, e, e1, e3, len, state->xor);
+    RPI_STATS_COUNT(state->private->stats, RPI_STATS_OP_POLY_LINE,
+                    RPI_STATS_STAGE_LINE, len, 1, state->dstBpp);
+}
+
+/*
+ * A line in screen coordinates, drawLast tells whether its end point is
+ * drawn. Adapted from fbSegment.
+ */
+static void
+xLineSegment(xLineState *state, int x1, int y1, int x2, int y2,
+             Bool drawLast)
+{
+    int adx, ady, signdx, signdy, octant;
+    int e, e1, e2, e3, len;
+    Bool x_major;
+    BoxPtr pbox, pboxEnd;
+
+    if (y1 == y2) {
+        if (x1 <= x2)
+            xLineBox(state, x1, y1, x2 + (drawLast ? 1 : 0), y1 + 1);
+        else
+            xLineBox(state, x2 + (drawLast ? 0 : 1), y1, x1 + 1, y1 + 1);
+        return;
+    }
+    if (x1 == x2) {
+        if (y1 <= y2)
+            xLineBox(state, x1, y1, x1 + 1, y2 + (drawLast ? 1 : 0));
+        else
+            xLineBox(state, x1, y2 + (drawLast ? 0 : 1), x1 + 1, y1 + 1);
+        return;
+    }
+
+    CalcLineDeltas(x1, y1, x2, y2, adx, ady, signdx, signdy, 1, 1, octant);
+    if (adx > ady) {
+        x_major = TRUE;
+        e1 = ady << 1;
+        e2 = e1 - (adx << 1);
+        e = e1 - adx;
+        len = adx;
+    }
+    else {
+        x_major = FALSE;
+        e1 = adx << 1;
+        e2 = e1 - (ady << 1);
+        e = e1 - ady;
+        SetYMajorOctant(octant);
+        len = ady;
+    }
+    FIXUP_ERROR(e, octant, state->bias);
+    /* Adjust the error terms to compare against zero */
+    e3 = e2 - e1;
+    e = e - e1;
+    if (drawLast)
+        len++;
+
+    pbox = xRegionFirstBox(state->pClipBoxes, state->nClipBoxes,
+                           y1 < y2 ? y1 : y2);
+    pboxEnd = state->pClipBoxes + state->nClipBoxes;
+    for (; pbox < pboxEnd && pbox->y1 <= (y1 > y2 ? y1 : y2); pbox++) {
+        int oc1 = 0, oc2 = 0;
+        int new_x1 = x1, new_y1 = y1, new_x2 = x2, new_y2 = y2;
+        int clip1 = 0, clip2 = 0;
+        int n, err;
+
+        OUTCODES(oc1, x1, y1, pbox);
+        OUTCODES(oc2, x2, y2, pbox);
+        if ((oc1 | oc2) == 0) {
+            xLineDraw(state, x1, y1, signdx, signdy, x_major, e, e1, e3, len);
+            break;
+        }
+        if (oc1 & oc2)
+            continue;
+        if (miZeroClipLine(pbox->x1, pbox->y1, pbox->x2 - 1, pbox->y2 - 1,
+                           &new_x1, &new_y1, &new_x2, &new_y2, adx, ady,
+                           &clip1, &clip2, octant, state->bias,
+                           oc1, oc2) == -1)
+            continue;
+        n = x_major ? abs(new_x2 - new_x1) : abs(new_y2 - new_y1);
+        if (clip2 != 0 || drawLast)
+            n++;
+        if (n == 0)
+            continue;
+        /* unwind the error term to the first point */
+        err = e;
+        if (clip1) {
+            int clipdx = abs(new_x1 - x1);
+            int clipdy = abs(new_y1 - y1);
+            if (x_major)
+                err += e3 * clipdy + e1 * clipdx;
+            else
+                err += e3 * clipdx + e1 * clipdy;
+        }
+        xLineDraw(state, new_x1, new_y1, signdx, signdy, x_major, err, e1,
+                  e3, n);
+    }
+}
+
+/* Adapted from fbPolySegment and fbZeroSegment. */
+static void
+xPolySegment(DrawablePtr pDrawable, GCPtr pGC, int nseg, xSegment *pSeg)
+{
+    xLineState state;
+    int x = pDrawable->x;
+    int y = pDrawable->y;
+    Bool drawLast = pGC->capStyle != CapNotLast;
+
+    if (!xLineAccepted(pDrawable, pGC)) {
+        fbPolySegment(pDrawable, pGC, nseg, pSeg);
+        return;
+    }
+
+    xLineBegin(&state, pDrawable, pGC);
+    while (nseg--) {
+        xLineSegment(&state, pSeg->x1 + x, pSeg->y1 + y,
+                     pSeg->x2 + x, pSeg->y2 + y, drawLast);
+        pSeg++;
+    }
+    xLineEnd(&state, pDrawable);
+}
+
+/* Adapted from fbPolyLine and fbZeroLine. */
+static void
+xPolyLine(DrawablePtr pDrawable, GCPtr pGC, int mode, int npt,
+          DDXPointPtr ppt)
+{
+    xLineState state;
+    int x = pDrawable->x;
+    int y = pDrawable->y;
+    int x1, y1, x2, y2;
+
+    if (!xLineAccepted(pDrawable, pGC)) {
+        fbPolyLine(pDrawable, pGC, mode, npt, ppt);
+        return;
+    }
+
+    xLineBegin(&state, pDrawable, pGC);
+    x1 = ppt->x;
+    y1 = ppt->y;
+    while (--npt > 0) {
+        ++ppt;
+        x2 = ppt->x;
+        y2 = ppt->y;
+        if (mode == CoordModePrevious) {
+            x2 += x1;
+            y2 += y1;
+        }
+        /* only the end point of the last line is subject to the cap style */
+        xLineSegment(&state, x1 + x, y1 + y, x2 + x, y2 + y,
+                     npt == 1 && pGC->capStyle != CapNotLast);
+        x1 = x2;
+        y1 = y2;
+    }
+    xLineEnd(&state, pDrawable);
+}
+
+/*
+ * The outlines which miPolyRectangle draws as closed PolyLines, as up to
+ * four boxes. Only a rectangle of zero size depends on the cap style.
+ */
+static void
+xPolyRectangle(DrawablePtr pDrawable, GCPtr pGC, int nrect,
+               xRectangle *prect)
+{
+    xLineState state;
+    int x = pDrawable->x;
+    int y = pDrawable->y;
+
+    if (!xLineAccepted(pDrawable, pGC)) {
+        miPolyRectangle(pDrawable, pGC, nrect, prect);
+        return;
+    }
+
+    xLineBegin(&state, pDrawable, pGC);
+    while (nrect--) {
+        int x1 = prect->x + x;
+        int y1 = prect->y + y;
+        int x2 = x1 + prect->width;
+        int y2 = y1 + prect->height;
+        if (x1 == x2 && y1 == y2) {
+            if (pGC->capStyle != CapNotLast)
+                xLineBox(&state, x1, y1, x1 + 1, y1 + 1);
+        }
+        else {
+            xLineBox(&state, x1, y1, x2 + 1, y1 + 1);
+            if (y2 > y1) {
+                xLineBox(&state, x1, y2, x2 + 1, y2 + 1);
+                xLineBox(&state, x1, y1 + 1, x1 + 1, y2);
+                if (x2 > x1)
+                    xLineBox(&state, x2, y1 + 1, x2 + 1, y2);
+            }
+        }
+        prect++;
+    }
+    xLineEnd(&state, pDrawable);
+}
+
+/*****************************************************************************/
+
+/*
+ * The spans of the filled circles and ellipses, and those which mi hands
+ * to FillSpans for everything else it rasterizes (wide lines, polygons,
+ * arcs). The spans are clipped and gathered in batches, like the boxes of
+ * the solid fills. The solid batches go to the fill_spans functions, the
+ * tiled and stippled ones are copied from the rows of the pattern.
+ */
+
+typedef struct {
+    RPIAccel     *private;
+    int           op;
+    FbBits       *dst;
+    FbStride      dstStride;
+    int           dstBpp;
+    int           dstXoff, dstYoff;
+    BoxPtr        pClipBoxes;
+    int           nClipBoxes;
+    FbBits        and, xor;
+    Bool          try_blt2d_fill, try_pixman_fill;
+    /* The pattern of the tiled and stippled spans */
+    Bool          patterned;
+    xPatternState pattern;
+    blt2d_span_t  batch[RPI_FILL_BATCH_SIZE];
+    int           nbatch;
+} xSpanState;
+
+/*
+ * Submit a batch of spans, in the pixel coordinates of the destination
+ * buffer, to the fill_spans functions. The spans they decline go through
+ * xFillBox.
+ */
+static void
+xFillSpanList(RPIAccel *private, int op, FbBits *dst, int dstStride,
+              int dstBpp, const blt2d_span_t *spans, int nspan, FbBits and,
+              FbBits xor, Bool try_blt2d_fill, Bool try_pixman_fill)
+{
+    blt2d_i *cpu_backend = private->blt2d_cpu_backend;
+
+    while (nspan > 0) {
+        int stage = RPI_STATS_STAGE_ACCEL;
+        int n = 0;
+        int i;
+
+        if (private->blt2d_fill_spans)
+            n = private->blt2d_fill_spans(private->blt2d_self,
+                                          (uint32_t *)dst, dstStride,
+                                          dstBpp, spans, nspan, 0, 0, xor);
+        if (n == 0 && cpu_backend && cpu_backend->fill_spans) {
+            stage = RPI_STATS_STAGE_CPU_BACKEND;
+            n = cpu_backend->fill_spans(cpu_backend->self,
+                                        (uint32_t *)dst, dstStride,
+                                        dstBpp, spans, nspan, 0, 0, xor);
+        }
+        if (n == 0) {
+            xFillBox(private, op, dst, dstStride, dstBpp, spans->x, spans->y,
+                     spans->width, 1, and, xor, try_blt2d_fill,
+                     try_pixman_fill);
+            n = 1;
+        } else if (private->stats) {
+            for (i = 0; i < n; i++)
+                rpi_stats_count(private->stats, op, stage, spans[i].width, 1,
+                                dstBpp);
+        }
+        spans += n;
+        nspan -= n;
+    }
+}
+
+/* Copy the spans of a tiled or stippled batch from the rows of the pattern */
+static void
+xPatternSpanList(xSpanState *state)
+{
+    int Bpp = state->dstBpp >> 3;
+    uint8_t *dst = (uint8_t *)state->dst;
+    intptr_t dstStrideBytes = state->dstStride * sizeof(FbBits);
+    fill_pattern_t *pat = &state->pattern.pat;
+    int i;
+
+    for (i = 0; i < state->nbatch; i++) {
+        const blt2d_span_t *span = &state->batch[i];
+        fill_pattern_row(pat, dst + span->y * dstStrideBytes + span->x * Bpp,
+                         fill_pattern_phase(span->x - state->pattern.x,
+                                            pat->width),
+                         fill_pattern_phase(span->y - state->pattern.y,
+                                            pat->height),
+                         span->width);
+        RPI_STATS_COUNT(state->private->stats, state->op,
+                        RPI_STATS_STAGE_SPAN, span->width, 1, state->dstBpp);
+    }
+}
+
+/* Whether the span hooks fill with this GC, fb or mi do otherwise */
+static Bool
+xSpanAccepted(DrawablePtr pDrawable, GCPtr pGC)
+{
+    FbGCPrivPtr pPriv = fbGetGCPrivate(pGC);
+    int bpp = pDrawable->bitsPerPixel;
+
+    return pGC->fillStyle == FillSolid && pPriv->pm == FB_ALLONES &&
+           !pPriv->and && (bpp == 8 || bpp == 16 || bpp == 24 || bpp == 32);
+}
+
+/* Returns FALSE if the pattern of the GC can't be prepared, fb fills then */
+static Bool
+xSpanBegin(xSpanState *state, int op, DrawablePtr pDrawable, GCPtr pGC)
+{
+    ScrnInfoPtr pScrn = xf86Screens[pDrawable->pScreen->myNum];
+    FbGCPrivPtr pPriv = fbGetGCPrivate(pGC);
+    RegionPtr pClip = fbGetCompositeClip(pGC);
+
+    state->private = RPI_ACCEL(pScrn);
+    state->op = op;
+    fbGetDrawable(pDrawable, state->dst, state->dstStride, state->dstBpp,
+                  state->dstXoff, state->dstYoff);
+    state->pClipBoxes = RegionRects(pClip);
+    state->nClipBoxes = RegionNumRects(pClip);
+    state->and = pPriv->and;
+    state->xor = pPriv->xor;
+    state->try_blt2d_fill = state->private->blt2d_fill != NULL;
+    state->try_pixman_fill = TRUE;
+    state->nbatch = 0;
+    state->patterned = pGC->fillStyle != FillSolid;
+    if (state->patterned &&
+        !xPatternBegin(&state->pattern, pDrawable, pGC, state->dstXoff,
+                       state->dstYoff)) {
+        fbFinishAccess(pDrawable);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void
+xSpanFlush(xSpanState *state)
+{
+    if (state->patterned)
+        xPatternSpanList(state);
+    else
+        xFillSpanList(state->private, state->op, state->dst,
+                      state->dstStride, state->dstBpp, state->batch,
+                      state->nbatch, state->and, state->xor,
+                      state->try_blt2d_fill, state->try_pixman_fill);
+    state->nbatch = 0;
+}
+
+static void
+xSpanEnd(xSpanState *state, DrawablePtr pDrawable)
+{
+    xSpanFlush(state);
+    if (state->patterned)
+        xPatternEnd(&state->pattern);
+    fbFinishAccess(pDrawable);
+}
+
+/* Clip the span of w pixels from x, y and add the pieces to the batch */
+static void
+xSpanAdd(xSpanState *state, int x, int y, int w)
+{
+    BoxPtr pbox = xRegionFirstBox(state->pClipBoxes, state->nClipBoxes, y);
+    BoxPtr pboxEnd = state->pClipBoxes + state->nClipBoxes;
+
+    /* the boxes of the band of y, if any */
+    for (; pbox < pboxEnd && pbox->y1 <= y; pbox++) {
+        blt2d_span_t *span;
+        int x1 = x, x2 = x + w;
+        if (x1 < pbox->x1)
+            x1 = pbox->x1;
+        if (x2 > pbox->x2)
+            x2 = pbox->x2;
+        if (x1 >= x2)
+            continue;
+        if (state->nbatch == RPI_FILL_BATCH_SIZE)
+            xSpanFlush(state);
+        span = &state->batch[state->nbatch++];
+        span->x = x1 + state->dstXoff;
+        span->y = y + state->dstYoff;
+        span->width = x2 - x1;
+    }
+}
+
+/*
+ * The full circles and ellipses, which mi would turn into spans for the
+ * generic FillSpans of fb, are scan converted here with fill_arc.h. The
+ * other arcs are left to miPolyFillArc.
+ */
+static void
+xPolyFillArc(DrawablePtr pDrawable, GCPtr pGC, int narcs, xArc *parcs)
+{
+    xSpanState state;
+
+    if (!xSpanAccepted(pDrawable, pGC)) {
+        miPolyFillArc(pDrawable, pGC, narcs, parcs);
+        return;
+    }
+
+    if (!xSpanBegin(&state, RPI_STATS_OP_POLY_FILL_ARC, pDrawable, pGC)) {
+        miPolyFillArc(pDrawable, pGC, narcs, parcs);
+        return;
+    }
+    for (; narcs > 0; narcs--, parcs++) {
+        fill_arc_t arc;
+        int x, w, y_upper, y_lower, rows;
+
+        if (!parcs->angle2 || fill_arc_empty(parcs->width, parcs->height))
+            continue;
+        /* the angles are in 1/64 degree */
+        if ((parcs->angle2 < 360 * 64 && parcs->angle2 > -360 * 64) ||
+            !fill_arc_exact(parcs->width, parcs->height)) {
+            /* the spans of mi go through the FillSpans of the GC */
+            xSpanFlush(&state);
+            miPolyFillArc(pDrawable, pGC, 1, parcs);
+            continue;
+        }
+        fill_arc_init(&arc, parcs->x + pDrawable->x,
+                      parcs->y + pDrawable->y, parcs->width, parcs->height);
+        while ((rows = fill_arc_step(&arc, &x, &w, &y_upper, &y_lower))) {
+            if (w <= 0)
+                continue;
+            xSpanAdd(&state, x, y_upper, w);
+            if (rows == 2)
+                xSpanAdd(&state, x, y_lower, w);
+        }
+    }
+    xSpanEnd(&state, pDrawable);
+}
+
+/*
+ * Adapted from fbFillSpans. The spans are in screen coordinates, and
+ * their order doesn't matter: fill_spans sorts each batch.
+ */
+static void
+xFillSpans(DrawablePtr pDrawable, GCPtr pGC, int n, DDXPointPtr ppt,
+           int *pwidth, int fSorted)
+{
+    xSpanState state;
+
+    if ((!xSpanAccepted(pDrawable, pGC) &&
+         !xPatternAccepted(pDrawable, pGC)) ||
+        !xSpanBegin(&state, RPI_STATS_OP_FILL_SPANS, pDrawable, pGC)) {
+        fbFillSpans(pDrawable, pGC, n, ppt, pwidth, fSorted);
+        return;
+    }
+
+    while (n--) {
+        if (*pwidth > 0)
+            xSpanAdd(&state, ppt->x, ppt->y, *pwidth);
+        ppt++;
+        pwidth++;
+    }
+    xSpanEnd(&state, pDrawable);
+}
+
+/*
+ * Adapted from fbSetSpans. The pixels of each span start at a word
+ * boundary of src and are copied a row piece at a time.
+ */
+static void
+xSetSpans(DrawablePtr pDrawable, GCPtr pGC, char *src, DDXPointPtr ppt,
+          int *pwidth, int nspans, int fSorted)
+{
+    FbGCPrivPtr pPriv = fbGetGCPrivate(pGC);
+    ScrnInfoPtr pScrn = xf86Screens[pDrawable->pScreen->myNum];
+    RPIAccel *private = RPI_ACCEL(pScrn);
+    RegionPtr pClip = fbGetCompositeClip(pGC);
+    BoxPtr pClipBoxes = RegionRects(pClip);
+    int nClipBoxes = RegionNumRects(pClip);
+    BoxPtr pbox, pboxEnd = pClipBoxes + nClipBoxes;
+    int bpp = pDrawable->bitsPerPixel;
+    FbBits *dst;
+    FbStride dstStride;
+    int dstBpp;
+    int dstXoff, dstYoff;
+    intptr_t dstStrideBytes;
+    int Bpp;
+
+    if (pGC->alu != GXcopy || pPriv->pm != FB_ALLONES ||
+        (bpp != 8 && bpp != 16 && bpp != 24 && bpp != 32)) {
+        fbSetSpans(pDrawable, pGC, src, ppt, pwidth, nspans, fSorted);
+        return;
+    }
+
+    fbGetDrawable(pDrawable, dst, dstStride, dstBpp, dstXoff, dstYoff);
+    dstStrideBytes = dstStride * sizeof(FbBits);
+    Bpp = dstBpp >> 3;
+    while (nspans--) {
+        for (pbox = xRegionFirstBox(pClipBoxes, nClipBoxes, ppt->y);
+             pbox < pboxEnd && pbox->y1 <= ppt->y; pbox++) {
+            int x1 = ppt->x;
+            int x2 = x1 + *pwidth;
+            if (x1 < pbox->x1)
+                x1 = pbox->x1;
+            if (x2 > pbox->x2)
+                x2 = pbox->x2;
+            if (x1 >= x2)
+                continue;
+            memcpy((uint8_t *)dst + (ppt->y + dstYoff) * dstStrideBytes +
+                   (x1 + dstXoff) * Bpp, src + (x1 - ppt->x) * Bpp,
+                   (x2 - x1) * Bpp);
+            RPI_STATS_COUNT(private->stats, RPI_STATS_OP_SET_SPANS,
+                            RPI_STATS_STAGE_SPAN, x2 - x1, 1, dstBpp);
+        }
+        src += PixmapBytePad(*pwidth, pDrawable->depth);
+        ppt++;
+        pwidth++;
+    }
+    fbFinishAccess(pDrawable);
+}
+
+/*****************************************************************************/
+
+/*
+ * Timed wrappers of the hooks, installed instead of them when the latency
+ * histograms are enabled, so that there is no cost otherwise.
+ */
+
+static void
+xLogLine(void *closure, const char *line)
+{
+    xf86DrvMsg(*(int *)closure, X_INFO, "%s\n", line);
+}
+
+static void
+xLatencyDump(ScrnInfoPtr pScrn, rpi_latency_t *latency)
+{
+    rpi_latency_dump_requested = 0;
+    rpi_latency_dump(latency, xLogLine, &pScrn->scrnIndex);
+}
+
+static void
+xLatencyCheckDump(ScreenPtr pScreen)
+{
+    ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+    if (rpi_latency_dump_requested)
+        xLatencyDump(pScrn, RPI_ACCEL(pScrn)->latency);
+}
+
+static void
+xCopyWindowTimed(WindowPtr pWin, DDXPointRec ptOldOrg, RegionPtr prgnSrc)
+{
+    ScreenPtr pScreen = pWin->drawable.pScreen;
+    rpi_latency_t *latency = RPI_ACCEL(xf86Screens[pScreen->myNum])->latency;
+    BoxPtr pextent = RegionExtents(prgnSrc);
+    int w = pextent->x2 - pextent->x1;
+    int h = pextent->y2 - pextent->y1;
+    uint64_t start;
+
+    if (!rpi_latency_sample(latency)) {
+        xCopyWindow(pWin, ptOldOrg, prgnSrc);
+        return;
+    }
+    start = rpi_latency_now();
+    xCopyWindow(pWin, ptOldOrg, prgnSrc);
+    rpi_latency_add(latency, RPI_STATS_OP_COPY_WINDOW, w, h, start);
+    xLatencyCheckDump(pScreen);
+}
+
+static RegionPtr
+xCopyAreaTimed(DrawablePtr pSrcDrawable,
+               DrawablePtr pDstDrawable,
+               GCPtr pGC,
+               int xIn, int yIn, int widthSrc, int heightSrc, int xOut, int yOut)
+{
+    ScreenPtr pScreen = pDstDrawable->pScreen;
+    rpi_latency_t *latency = RPI_ACCEL(xf86Screens[pScreen->myNum])->latency;
+    RegionPtr result;
+    uint64_t start;
+
+    if (!rpi_latency_sample(latency))
+        return xCopyArea(pSrcDrawable, pDstDrawable, pGC, xIn, yIn,
+                         widthSrc, heightSrc, xOut, yOut);
+    start = rpi_latency_now();
+    result = xCopyArea(pSrcDrawable, pDstDrawable, pGC, xIn, yIn,
+                       widthSrc, heightSrc, xOut, yOut);
+    rpi_latency_add(latency, RPI_STATS_OP_COPY_AREA, widthSrc, heightSrc,
+                    start);
+    xLatencyCheckDump(pScreen);
+    return result;
+}
+
+static void
+xGetImageTimed(DrawablePtr pDrawable, int x, int y, int w, int h,
+               unsigned int format, unsigned long planeMask, char *d)
+{
+    ScreenPtr pScreen = pDrawable->pScreen;
+    rpi_latency_t *latency = RPI_ACCEL(xf86Screens[pScreen->myNum])->latency;
+    uint64_t start;
+
+    if (!rpi_latency_sample(latency)) {
+        xGetImage(pDrawable, x, y, w, h, format, planeMask, d);
+        return;
+    }
+    start = rpi_latency_now();
+    xGetImage(pDrawable, x, y, w, h, format, planeMask, d);
+    rpi_latency_add(latency, RPI_STATS_OP_GET_IMAGE, w, h, start);
+    xLatencyCheckDump(pScreen);
+}
+
+static void
+xPutImageTimed(DrawablePtr pDrawable,
+               GCPtr pGC,
+               int depth,
+               int x, int y, int w, int h, int leftPad, int format, char *pImage)
+{
+    ScreenPtr pScreen = pDrawable->pScreen;
+    rpi_latency_t *latency = RPI_ACCEL(xf86Screens[pScreen->myNum])->latency;
+    uint64_t start;
+
+    if (!rpi_latency_sample(latency)) {
+        xPutImage(pDrawable, pGC, depth, x, y, w, h, leftPad, format, pImage);
+        return;
+    }
+    start = rpi_latency_now();
+    xPutImage(pDrawable, pGC, depth, x, y, w, h, leftPad, format, pImage);
+    rpi_latency_add(latency, RPI_STATS_OP_PUT_IMAGE, w, h, start);
+    xLatencyCheckDump(pScreen);
+}
+
+static void
+xPolyFillRectTimed(DrawablePtr pDrawable,
+                   GCPtr pGC,
+                   int nrect,
+                   xRectangle * prect)
+{
+    ScreenPtr pScreen = pDrawable->pScreen;
+    rpi_latency_t *latency = RPI_ACCEL(xf86Screens[pScreen->myNum])->latency;
+    uint64_t start;
+    uint32_t area = 0;
+    int i;
+
+    if (!rpi_latency_sample(latency)) {
+        xPolyFillRect(pDrawable, pGC, nrect, prect);
+        return;
+    }
+    /* The size class is taken from the total area of the rectangles */
+    for (i = 0; i < nrect; i++)
+        area += (uint32_t)prect[i].width * prect[i].height;
+    start = rpi_latency_now();
+    xPolyFillRect(pDrawable, pGC, nrect, prect);
+    rpi_latency_add(latency, RPI_STATS_OP_POLY_FILL_RECT, area, 1, start);
+    xLatencyCheckDump(pScreen);
+}
+
+/* The size class of the line hooks is taken from the total length */
+static void
+xPolySegmentTimed(DrawablePtr pDrawable, GCPtr pGC, int nseg, xSegment *pSeg)
+{
+    ScreenPtr pScreen = pDrawable->pScreen;
+    rpi_latency_t *latency = RPI_ACCEL(xf86Screens[pScreen->myNum])->latency;
+    uint64_t start;
+    uint32_t length = 0;
+    int i;
+
+    if (!rpi_latency_sample(latency)) {
+        xPolySegment(pDrawable, pGC, nseg, pSeg);
+        return;
+    }
+    for (i = 0; i < nseg; i++)
+        length += abs(pSeg[i].x2 - pSeg[i].x1) + abs(pSeg[i].y2 - pSeg[i].y1);
+    start = rpi_latency_now();
+    xPolySegment(pDrawable, pGC, nseg, pSeg);
+    rpi_latency_add(latency, RPI_STATS_OP_POLY_LINE, length, 1, start);
+    xLatencyCheckDump(pScreen);
+}
+
+static void
+xPolyLineTimed(DrawablePtr pDrawable, GCPtr pGC, int mode, int npt,
+               DDXPointPtr ppt)
+{
+    ScreenPtr pScreen = pDrawable->pScreen;
+    rpi_latency_t *latency = RPI_ACCEL(xf86Screens[pScreen->myNum])->latency;
+    uint64_t start;
+    uint32_t length = 0;
+    int i;
+
+    if (!rpi_latency_sample(latency)) {
+        xPolyLine(pDrawable, pGC, mode, npt, ppt);
+        return;
+    }
+    for (i = 1; i < npt; i++) {
+        if (mode == CoordModePrevious)
+            length += abs(ppt[i].x) + abs(ppt[i].y);
+        else
+            length += abs(ppt[i].x - ppt[i - 1].x) +
+                      abs(ppt[i].y - ppt[i - 1].y);
+    }
+    start = rpi_latency_now();
+    xPolyLine(pDrawable, pGC, mode, npt, ppt);
+    rpi_latency_add(latency, RPI_STATS_OP_POLY_LINE, length, 1, start);
+    xLatencyCheckDump(pScreen);
+}
+
+static void
+xPolyRectangleTimed(DrawablePtr pDrawable, GCPtr pGC, int nrect,
+                    xRectangle *prect)
+{
+    ScreenPtr pScreen = pDrawable->pScreen;
+    rpi_latency_t *latency = RPI_ACCEL(xf86Screens[pScreen->myNum])->latency;
+    uint64_t start;
+    uint32_t length = 0;
+    int i;
+
+    if (!rpi_latency_sample(latency)) {
+        xPolyRectangle(pDrawable, pGC, nrect, prect);
+        return;
+    }
+    for (i = 0; i < nrect; i++)
+        length += 2 * ((uint32_t)prect[i].width + prect[i].height);
+    start = rpi_latency_now();
+    xPolyRectangle(pDrawable, pGC, nrect, prect);
+    rpi_latency_add(latency, RPI_STATS_OP_POLY_LINE, length, 1, start);
+    xLatencyCheckDump(pScreen);
+}
+
+/* The size class of the span hooks is taken from the total width */
+static void
+xFillSpansTimed(DrawablePtr pDrawable, GCPtr pGC, int n, DDXPointPtr ppt,
+                int *pwidth, int fSorted)
+{
+    ScreenPtr pScreen = pDrawable->pScreen;
+    rpi_latency_t *latency = RPI_ACCEL(xf86Screens[pScreen->myNum])->latency;
+    uint64_t start;
+    uint32_t width = 0;
+    int i;
+
+    if (!rpi_latency_sample(latency)) {
+        xFillSpans(pDrawable, pGC, n, ppt, pwidth, fSorted);
+        return;
+    }
+    for (i = 0; i < n; i++)
+        width += pwidth[i] > 0 ? pwidth[i] : 0;
+    start = rpi_latency_now();
+    xFillSpans(pDrawable, pGC, n, ppt, pwidth, fSorted);
+    rpi_latency_add(latency, RPI_STATS_OP_FILL_SPANS, width, 1, start);
+    xLatencyCheckDump(pScreen);
+}
+
+static void
+xSetSpansTimed(DrawablePtr pDrawable, GCPtr pGC, char *src, DDXPointPtr ppt,
+               int *pwidth, int nspans, int fSorted)
+{
+    ScreenPtr pScreen = pDrawable->pScreen;
+    rpi_latency_t *latency = RPI_ACCEL(xf86Screens[pScreen->myNum])->latency;
+    uint64_t start;
+    uint32_t width = 0;
+    int i;
+
+    if (!rpi_latency_sample(latency)) {
+        xSetSpans(pDrawable, pGC, src, ppt, pwidth, nspans, fSorted);
+        return;
+    }
+    for (i = 0; i < nspans; i++)
+        width += pwidth[i] > 0 ? pwidth[i] : 0;
+    start = rpi_latency_now();
+    xSetSpans(pDrawable, pGC, src, ppt, pwidth, nspans, fSorted);
+    rpi_latency_add(latency, RPI_STATS_OP_SET_SPANS, width, 1, start);
+    xLatencyCheckDump(pScreen);
+}
+
+static void
+xPolyFillArcTimed(DrawablePtr pDrawable, GCPtr pGC, int narcs, xArc *parcs)
+{
+    ScreenPtr pScreen = pDrawable->pScreen;
+    rpi_latency_t *latency = RPI_ACCEL(xf86Screens[pScreen->myNum])->latency;
+    uint64_t start;
+    uint32_t area = 0;
+    int i;
+
+    if (!rpi_latency_sample(latency)) {
+        xPolyFillArc(pDrawable, pGC, narcs, parcs);
+        return;
+    }
+    /* The size class is taken from the bounding boxes of the arcs */
+    for (i = 0; i < narcs; i++)
+        area += (uint32_t)parcs[i].width * parcs[i].height;
+    start = rpi_latency_now();
+    xPolyFillArc(pDrawable, pGC, narcs, parcs);
+    rpi_latency_add(latency, RPI_STATS_OP_POLY_FILL_ARC, area, 1, start);
+    xLatencyCheckDump(pScreen);
+}
+
+/*****************************************************************************/
+
+static Bool
+xCreateGC(GCPtr pGC)
+{
+    ScreenPtr pScreen = pGC->pScreen;
+    ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+    RPIAccel *self = RPI_ACCEL(pScrn);
+    Bool result;
+
+    if (!fbCreateGC(pGC))
+        return FALSE;
+
+    if (!self->pGCOps) {
+        self->pGCOps = calloc(1, sizeof(GCOps));
         memcpy(self->pGCOps, pGC->ops, sizeof(GCOps));
 
         /* Add our own hook for CopyArea function */
-        self->pGCOps->CopyArea = xCopyArea;
+        self->pGCOps->CopyArea = self->latency ? xCopyAreaTimed : xCopyArea;
         /* Add our own hook for PutImage */
-        self->pGCOps->PutImage = xPutImage;
+        self->pGCOps->PutImage = self->latency ? xPutImageTimed : xPutImage;
         /* Add our own hook for PolyFillRect */
-        self->pGCOps->PolyFillRect = xPolyFillRect;
+        self->pGCOps->PolyFillRect = self->latency ? xPolyFillRectTimed
+                                                   : xPolyFillRect;
+        /* And for the zero width lines */
+        self->pGCOps->PolySegment = self->latency ? xPolySegmentTimed
+                                                  : xPolySegment;
+        self->pGCOps->Polylines = self->latency ? xPolyLineTimed : xPolyLine;
+        self->pGCOps->PolyRectangle = self->latency ? xPolyRectangleTimed
+                                                    : xPolyRectangle;
+        self->pGCOps->PolyFillArc = self->latency ? xPolyFillArcTimed
+                                                  : xPolyFillArc;
+        /* And for the spans of everything else mi rasterizes */
+        self->pGCOps->FillSpans = self->latency ? xFillSpansTimed
+                                                : xFillSpans;
+        self->pGCOps->SetSpans = self->latency ? xSetSpansTimed : xSetSpans;
     }
     pGC->ops = self->pGCOps;
 
@@ -576,11 +2281,21 @@ RPIAccel *RPIAccel_Init(ScreenPtr pScreen, blt2d_i *blt2d, blt2d_i *blt2d_cpu_ba
     private->blt2d_overlapped_blt = blt2d->overlapped_blt;
     private->blt2d_standard_blt = blt2d->standard_blt;
     private->blt2d_fill = blt2d->fill;
+    private->blt2d_overlapped_blt_route = blt2d->overlapped_blt_route;
+    private->blt2d_overlapped_blt_boxes = blt2d->overlapped_blt_boxes;
+    private->blt2d_fill_boxes = blt2d->fill_boxes;
+    private->blt2d_fill_spans = blt2d->fill_spans;
+    private->blt2d_readback_blt = blt2d->readback_blt;
+    private->blt2d_rop_blt = blt2d->rop_blt;
 
     /* Wrap the current CopyWindow function */
     private->CopyWindow = pScreen->CopyWindow;
     pScreen->CopyWindow = xCopyWindow;
 
+    /* Wrap the current GetImage function */
+    private->GetImage = pScreen->GetImage;
+    pScreen->GetImage = xGetImage;
+
     /* Wrap the current CreateGC function */
     private->CreateGC = pScreen->CreateGC;
     pScreen->CreateGC = xCreateGC;
@@ -595,8 +2310,121 @@ void RPIAccel_Close(ScreenPtr pScreen)
 
     pScreen->CopyWindow = private->CopyWindow;
     pScreen->CreateGC   = private->CreateGC;
+    pScreen->GetImage   = private->GetImage;
 
     if (private->pGCOps) {
         free(private->pGCOps);
     }
+
+    if (private->stats) {
+        rpi_stats_close(private->stats, private->stats_name);
+        private->stats = NULL;
+    }
+
+    if (private->trace) {
+        if (!rpi_trace_close(private->trace))
+            xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+                       "failed to write the end of the trace file\n");
+        private->trace = NULL;
+    }
+
+    if (private->adapt) {
+        rpi_adapt_dump(private->adapt, xLogLine, &pScrn->scrnIndex);
+        rpi_adapt_close(private->adapt);
+        private->adapt = NULL;
+    }
+
+    if (private->latency) {
+        xLatencyDump(pScrn, private->latency);
+        rpi_latency_close(private->latency);
+        private->latency = NULL;
+    }
+}
+
+/*
+ * Publish the dispatch statistics in a shared memory segment named after
+ * the display, where they can be read by the rpifb-stats tool.
+ */
+void RPIAccel_EnableStatistics(ScreenPtr pScreen)
+{
+    ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+    RPIAccel *private = RPI_ACCEL(pScrn);
+
+    snprintf(private->stats_name, sizeof(private->stats_name), "%s%s",
+             RPI_STATS_SHM_PREFIX, display);
+    private->stats = rpi_stats_init(private->stats_name);
+    if (private->stats)
+        xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+                   "dispatch statistics available in shared memory %s\n",
+                   private->stats_name);
+    else
+        xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+                   "failed to create shared memory %s for statistics\n",
+                   private->stats_name);
+}
+
+/*
+ * Record every hooked operation to a trace file, which can be replayed
+ * offline by the rpifb-replay tool.
+ */
+void RPIAccel_EnableTrace(ScreenPtr pScreen, const char *filename,
+                          Bool hash_images)
+{
+    ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+    RPIAccel *private = RPI_ACCEL(pScrn);
+
+    /* The screen pixmap doesn't exist yet, use the mode of the screen */
+    private->trace = rpi_trace_open(filename, pScrn->virtualX,
+                                    pScrn->virtualY, pScrn->bitsPerPixel,
+                                    hash_images);
+    if (private->trace)
+        xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+                   "recording a trace of the drawing operations to %s\n",
+                   filename);
+    else
+        xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+                   "failed to open trace file %s\n", filename);
+}
+
+/*
+ * Time one in every sample_interval calls of the hooked operations and
+ * collect latency histograms, which are written to the log on SIGUSR2
+ * and when the screen is closed.
+ */
+void RPIAccel_EnableLatency(ScreenPtr pScreen, int sample_interval)
+{
+    ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+    RPIAccel *private = RPI_ACCEL(pScrn);
+
+    private->latency = rpi_latency_init(sample_interval);
+    if (!private->latency) {
+        xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+                   "failed to enable the latency histograms\n");
+        return;
+    }
+    /* The GC hooks pick the timed versions when they are created */
+    pScreen->CopyWindow = xCopyWindowTimed;
+    pScreen->GetImage = xGetImageTimed;
+    xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+               "timing 1 in %d drawing operations, send SIGUSR2 to dump "
+               "the latency histograms\n", private->latency->sample_interval);
+}
+
+/*
+ * Let the backends adapt their size thresholds to timings of the boxes
+ * drawn, see rpi_adapt.h. The caller hands private->adapt to the backends.
+ */
+void RPIAccel_EnableAdaptiveThresholds(ScreenPtr pScreen)
+{
+    ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+    RPIAccel *private = RPI_ACCEL(pScrn);
+
+    private->adapt = rpi_adapt_init();
+    if (private->adapt)
+        xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+                   "adaptive dispatch thresholds enabled, timing 1 in %d "
+                   "boxes\n", RPI_ADAPT_SAMPLE_INTERVAL);
+    else
+        xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+                   "failed to enable the adaptive dispatch thresholds\n");
 }
@@ -28,12 +28,25 @@
 #define RPI_X_H
 
 #include "interfaces.h"
+#include "rpi_stats.h"
+#include "rpi_trace.h"
+#include "rpi_latency.h"
+#include "rpi_adapt.h"
+
+/* The entries of the copy dispatch table */
+#define RPI_ROUTE_KNOWN             1
+#define RPI_ROUTE_ACCEL             2 /* try blt2d_overlapped_blt */
+#define RPI_ROUTE_CPU_BACKEND       4 /* try blt2d_cpu_backend */
+#define RPI_ROUTE_SMALL             8 /* small_blt, instead of the others */
+/* The width classes, the same as rpi_adapt_width_class */
+#define RPI_ROUTE_NUM_WIDTH_CLASSES RPI_STATS_NUM_SIZE_BUCKETS
 
 typedef struct {
     GCOps                  *pGCOps;
 
     CopyWindowProcPtr       CopyWindow;
     CreateGCProcPtr         CreateGC;
+    GetImageProcPtr         GetImage;
 
     /* SunxiG2D_Init copies these pointers here from blt2d_i struct */
     void *blt2d_self;
@@ -72,10 +85,107 @@ typedef struct {
                 int       width,
                 int       height,
                 uint32_t  color);
+    int (*blt2d_overlapped_blt_route)(void     *self,
+                                      uint32_t *src_bits,
+                                      uint32_t *dst_bits,
+                                      int       src_stride,
+                                      int       dst_stride,
+                                      int       src_bpp,
+                                      int       dst_bpp,
+                                      int       reverse,
+                                      int       upsidedown,
+                                      int       min_w,
+                                      int       max_w);
+    int (*blt2d_overlapped_blt_boxes)(void              *self,
+                                      uint32_t          *src_bits,
+                                      uint32_t          *dst_bits,
+                                      int                src_stride,
+                                      int                dst_stride,
+                                      int                src_bpp,
+                                      int                dst_bpp,
+                                      const blt2d_box_t *boxes,
+                                      int                nbox,
+                                      int                src_dx,
+                                      int                src_dy,
+                                      int                dst_dx,
+                                      int                dst_dy);
+    int (*blt2d_fill_boxes)(void              *self,
+                            uint32_t          *bits,
+                            int                stride,
+                            int                bpp,
+                            const blt2d_box_t *boxes,
+                            int                nbox,
+                            int                dx,
+                            int                dy,
+                            uint32_t           color);
+    int (*blt2d_fill_spans)(void               *self,
+                            uint32_t           *bits,
+                            int                 stride,
+                            int                 bpp,
+                            const blt2d_span_t *spans,
+                            int                 nspan,
+                            int                 dx,
+                            int                 dy,
+                            uint32_t            color);
+    int (*blt2d_readback_blt)(void     *self,
+                              uint32_t *src_bits,
+                              uint32_t *dst_bits,
+                              int       src_stride,
+                              int       dst_stride,
+                              int       bpp,
+                              int       src_x,
+                              int       src_y,
+                              int       dst_x,
+                              int       dst_y,
+                              int       w,
+                              int       h);
+    int (*blt2d_rop_blt)(void     *self,
+                         uint32_t *src_bits,
+                         uint32_t *dst_bits,
+                         int       src_stride,
+                         int       dst_stride,
+                         int       src_bpp,
+                         int       dst_bpp,
+                         int       src_x,
+                         int       src_y,
+                         int       dst_x,
+                         int       dst_y,
+                         int       w,
+                         int       h,
+                         int       alu,
+                         uint32_t  planemask);
     blt2d_i *blt2d_cpu_backend;
+
+    /*
+     * The dispatch table of the copies: the RPI_ROUTE_* stages to try,
+     * indexed by the bpp, the fbBlt reverse and upsidedown flags, whether
+     * the source and the destination are the screen pixmap, whether they
+     * are the same pixmap, and the log2 of the width. Filled on first use,
+     * 0 means not known yet.
+     */
+    uint8_t copy_route[RPI_STATS_NUM_BPP][4][2][2][2]
+                      [RPI_ROUTE_NUM_WIDTH_CLASSES];
+
+    /* Dispatch statistics in shared memory, NULL when disabled */
+    rpi_stats_t            *stats;
+    char                    stats_name[64];
+
+    /* Trace recorder, NULL when disabled */
+    rpi_trace_t            *trace;
+
+    /* Latency histograms, NULL when disabled */
+    rpi_latency_t          *latency;
+
+    /* Adaptive dispatch thresholds, NULL when disabled */
+    rpi_adapt_t            *adapt;
 } RPIAccel;
 
 RPIAccel *RPIAccel_Init(ScreenPtr pScreen, blt2d_i *blt2d, blt2d_i *blt2d_cpu_backend);
 void RPIAccel_Close(ScreenPtr pScreen);
+void RPIAccel_EnableStatistics(ScreenPtr pScreen);
+void RPIAccel_EnableTrace(ScreenPtr pScreen, const char *filename,
+                          Bool hash_images);
+void RPIAccel_EnableLatency(ScreenPtr pScreen, int sample_interval);
+void RPIAccel_EnableAdaptiveThresholds(ScreenPtr pScreen);
 
 #endif
@@ -0,0 +1,121 @@
+/*
+ * Copyright © 2013 The xf86-video-rpifb authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SMALL_BLT_H
+#define SMALL_BLT_H
+
+#include <string.h>
+#include <inttypes.h>
+
+/*
+ * Inlined copy kernels for tiny rectangles, which are called directly
+ * from the copy and PutImage hooks of rpi_x.c instead of going through
+ * the blt2d_i chain. A row of n bytes, with chunk <= n <= 2 * chunk, is
+ * copied as a head and a tail of chunk bytes, which may overlap. Both are
+ * loaded before they are stored, so that the rows of overlapped copies
+ * are correct in both directions. The kernels are generated for each
+ * power of two chunk size, the bpp and the width class of a rectangle
+ * (see rpi_adapt_width_class) select the chunk. The rows of 24bpp pixels
+ * don't have to be split at pixel boundaries, they are copied the same way.
+ */
+
+/* The rows must be narrower than SMALL_BLT_MAX_BYTES */
+#define SMALL_BLT_MAX_BYTES 64
+
+#define SMALL_BLT_KERNEL(chunk)                                            \
+static inline void                                                         \
+small_blt_##chunk(uint8_t *dst, intptr_t dst_stride, const uint8_t *src,   \
+                  intptr_t src_stride, int bytes, int height)              \
+{                                                                          \
+    while (height-- > 0) {                                                 \
+        uint8_t head[chunk], tail[chunk];                                  \
+        memcpy(head, src, chunk);                                          \
+        memcpy(tail, src + bytes - chunk, chunk);                          \
+        memcpy(dst, head, chunk);                                          \
+        memcpy(dst + bytes - chunk, tail, chunk);                          \
+        src += src_stride;                                                 \
+        dst += dst_stride;                                                 \
+    }                                                                      \
+}
+
+SMALL_BLT_KERNEL(1)
+SMALL_BLT_KERNEL(2)
+SMALL_BLT_KERNEL(4)
+SMALL_BLT_KERNEL(8)
+SMALL_BLT_KERNEL(16)
+SMALL_BLT_KERNEL(32)
+
+/* Whether all the widths of a width class are taken at this bpp */
+static inline int
+small_blt_width_class_ok(int bpp, int width_class)
+{
+    if (bpp != 8 && bpp != 16 && bpp != 24 && bpp != 32)
+        return 0;
+    return (2 << width_class) * (bpp >> 3) <= SMALL_BLT_MAX_BYTES;
+}
+
+/*
+ * The arguments are those of blt2d_i.overlapped_blt (strides in 32-bit
+ * words), plus the upsidedown flag of fbBlt, which makes the rows go
+ * from the bottom up. Returns 0 when the rectangle is too wide.
+ */
+static inline int
+small_blt(uint32_t *src_bits, uint32_t *dst_bits, int src_stride,
+          int dst_stride, int bpp, int src_x, int src_y, int dst_x,
+          int dst_y, int width, int height, int upsidedown)
+{
+    int bytes = width * (bpp >> 3);
+    intptr_t src_stride_bytes = (intptr_t) src_stride * 4;
+    intptr_t dst_stride_bytes = (intptr_t) dst_stride * 4;
+    uint8_t *src = (uint8_t *)src_bits + src_y * src_stride_bytes +
+                   src_x * (bpp >> 3);
+    uint8_t *dst = (uint8_t *)dst_bits + dst_y * dst_stride_bytes +
+                   dst_x * (bpp >> 3);
+
+    if ((bpp != 8 && bpp != 16 && bpp != 24 && bpp != 32) || bytes <= 0 ||
+        bytes >= SMALL_BLT_MAX_BYTES)
+        return 0;
+
+    if (upsidedown) {
+        src += (height - 1) * src_stride_bytes;
+        dst += (height - 1) * dst_stride_bytes;
+        src_stride_bytes = -src_stride_bytes;
+        dst_stride_bytes = -dst_stride_bytes;
+    }
+
+    if (bytes >= 32)
+        small_blt_32(dst, dst_stride_bytes, src, src_stride_bytes, bytes, height);
+    else if (bytes >= 16)
+        small_blt_16(dst, dst_stride_bytes, src, src_stride_bytes, bytes, height);
+    else if (bytes >= 8)
+        small_blt_8(dst, dst_stride_bytes, src, src_stride_bytes, bytes, height);
+    else if (bytes >= 4)
+        small_blt_4(dst, dst_stride_bytes, src, src_stride_bytes, bytes, height);
+    else if (bytes >= 2)
+        small_blt_2(dst, dst_stride_bytes, src, src_stride_bytes, bytes, height);
+    else
+        small_blt_1(dst, dst_stride_bytes, src, src_stride_bytes, bytes, height);
+    return 1;
+}
+
+#endif
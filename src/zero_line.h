@@ -0,0 +1,118 @@
+/*
+ * Copyright © 2013 The xf86-video-rpifb authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef ZERO_LINE_H
+#define ZERO_LINE_H
+
+#include <inttypes.h>
+
+/*
+ * Bresenham kernels for the zero width solid lines of the PolySegment,
+ * PolyLine and PolyRectangle hooks of rpi_x.c, which only hand them the
+ * diagonal lines (the others are fills). The parameters are those which
+ * fbSegment passes to fbBresSolid: the error term e is compared against
+ * zero, e1 is added at every step along the major axis and e3 as well
+ * when the minor axis is stepped. The caller clips the line against each
+ * clip box beforehand with miZeroClipLine, the kernels only step a
+ * pointer.
+ */
+
+#define ZERO_LINE_KERNEL(bpp, type)                                        \
+static inline void                                                         \
+zero_line_##bpp(uint8_t *p, intptr_t major_step, intptr_t minor_step,      \
+                int e, int e1, int e3, int len, uint32_t color)            \
+{                                                                          \
+    while (len-- > 0) {                                                    \
+        *(type *)p = color;                                                \
+        p += major_step;                                                   \
+        e += e1;                                                           \
+        if (e >= 0) {                                                      \
+            p += minor_step;                                               \
+            e += e3;                                                       \
+        }                                                                  \
+    }                                                                      \
+}
+
+ZERO_LINE_KERNEL(8, uint8_t)
+ZERO_LINE_KERNEL(16, uint16_t)
+ZERO_LINE_KERNEL(32, uint32_t)
+
+/* 24bpp pixels are written as three bytes, in the order of fb */
+static inline void
+zero_line_24(uint8_t *p, intptr_t major_step, intptr_t minor_step,
+             int e, int e1, int e3, int len, uint32_t color)
+{
+    while (len-- > 0) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        p[0] = color >> 16;
+        p[1] = color >> 8;
+        p[2] = color;
+#else
+        p[0] = color;
+        p[1] = color >> 8;
+        p[2] = color >> 16;
+#endif
+        p += major_step;
+        e += e1;
+        if (e >= 0) {
+            p += minor_step;
+            e += e3;
+        }
+    }
+}
+
+/*
+ * Draw len pixels from (x, y), stepping by signdx and signdy along the
+ * axes, x being the major axis if x_major is set. The stride is in 32-bit
+ * words. Returns 0 for an unsupported bpp.
+ */
+static inline int
+zero_line(uint32_t *bits, int stride, int bpp, int x, int y, int signdx,
+          int signdy, int x_major, int e, int e1, int e3, int len,
+          uint32_t color)
+{
+    intptr_t stride_bytes = (intptr_t) stride * 4;
+    uint8_t *p = (uint8_t *)bits + y * stride_bytes + x * (bpp >> 3);
+    intptr_t x_step = signdx * (bpp >> 3);
+    intptr_t y_step = signdy * stride_bytes;
+    intptr_t major_step = x_major ? x_step : y_step;
+    intptr_t minor_step = x_major ? y_step : x_step;
+
+    switch (bpp) {
+    case 8:
+        zero_line_8(p, major_step, minor_step, e, e1, e3, len, color);
+        return 1;
+    case 16:
+        zero_line_16(p, major_step, minor_step, e, e1, e3, len, color);
+        return 1;
+    case 24:
+        zero_line_24(p, major_step, minor_step, e, e1, e3, len, color);
+        return 1;
+    case 32:
+        zero_line_32(p, major_step, minor_step, e, e1, e3, len, color);
+        return 1;
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,150 @@
+/*
+ * Copyright © 2013 The xf86-video-rpifb authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Print the statistics published by the driver when Option "Statistics"
+ * is enabled in xorg.conf.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+
+#include "rpi_stats.h"
+
+static void
+print_dispatch(const rpi_stats_t *stats, const rpi_stats_t *prev)
+{
+    int op, stage;
+
+    printf("%-14s %-14s %12s %14s %16s\n",
+           "operation", "stage", "calls", "pixels", "bytes");
+    for (op = 0; op < RPI_STATS_NUM_OPS; op++) {
+        for (stage = 0; stage < RPI_STATS_NUM_STAGES; stage++) {
+            rpi_stats_counter_t c = stats->dispatch[op][stage];
+            if (prev) {
+                c.calls -= prev->dispatch[op][stage].calls;
+                c.pixels -= prev->dispatch[op][stage].pixels;
+                c.bytes -= prev->dispatch[op][stage].bytes;
+            }
+            if (c.calls == 0)
+                continue;
+            printf("%-14s %-14s %12" PRIu64 " %14" PRIu64 " %16" PRIu64 "\n",
+                   rpi_stats_op_names[op], rpi_stats_stage_names[stage],
+                   c.calls, c.pixels, c.bytes);
+        }
+    }
+}
+
+static void
+print_fallbacks(const rpi_stats_t *stats, const rpi_stats_t *prev)
+{
+    int reason, bpp, bucket;
+
+    printf("\n%-20s %-5s", "declined because", "bpp");
+    /* label the size buckets with the side of the equivalent square */
+    for (bucket = 0; bucket < RPI_STATS_NUM_SIZE_BUCKETS - 1; bucket++)
+        printf(" %7d", 1 << bucket);
+    printf(" %6d+\n", 1 << bucket);
+
+    for (reason = 0; reason < RPI_STATS_NUM_REASONS; reason++) {
+        for (bpp = 0; bpp < RPI_STATS_NUM_BPP; bpp++) {
+            uint64_t counts[RPI_STATS_NUM_SIZE_BUCKETS];
+            uint64_t total = 0;
+            for (bucket = 0; bucket < RPI_STATS_NUM_SIZE_BUCKETS; bucket++) {
+                counts[bucket] = stats->fallbacks[reason][bpp][bucket];
+                if (prev)
+                    counts[bucket] -= prev->fallbacks[reason][bpp][bucket];
+                total += counts[bucket];
+            }
+            if (total == 0)
+                continue;
+            printf("%-20s %-5s", rpi_stats_reason_names[reason],
+                   rpi_stats_bpp_names[bpp]);
+            for (bucket = 0; bucket < RPI_STATS_NUM_SIZE_BUCKETS; bucket++)
+                printf(" %7" PRIu64, counts[bucket]);
+            printf("\n");
+        }
+    }
+}
+
+static void
+usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [-d display] [-i seconds]\n"
+            "  -d display  the display number of the X server (default 0)\n"
+            "  -i seconds  keep running and print the counts of each interval\n",
+            name);
+}
+
+int
+main(int argc, char *argv[])
+{
+    const char *display = "0";
+    const rpi_stats_t *stats;
+    rpi_stats_t prev;
+    char name[64];
+    int interval = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "d:i:h")) != -1) {
+        switch (c) {
+        case 'd':
+            /* accept both "0" and ":0" */
+            display = optarg[0] == ':' ? optarg + 1 : optarg;
+            break;
+        case 'i':
+            interval = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+
+    snprintf(name, sizeof(name), "%s%s", RPI_STATS_SHM_PREFIX, display);
+    stats = rpi_stats_open(name);
+    if (!stats) {
+        fprintf(stderr, "can't open %s, is Option \"Statistics\" enabled?\n",
+                name);
+        return 1;
+    }
+
+    printf("X server pid %d\n", stats->pid);
+    print_dispatch(stats, NULL);
+    print_fallbacks(stats, NULL);
+
+    while (interval > 0) {
+        memcpy(&prev, stats, sizeof(prev));
+        sleep(interval);
+        printf("\n");
+        print_dispatch(stats, &prev);
+        print_fallbacks(stats, &prev);
+        fflush(stdout);
+    }
+
+    return 0;
+}